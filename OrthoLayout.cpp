@@ -1,12 +1,26 @@
 #include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <random>
 #include <ranges>
 #include <optional>
 #include <tuple>
+#include <regex>
+#include <filesystem>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include <hyprland/src/Compositor.hpp>
 #include <hyprland/src/desktop/state/FocusState.hpp>
 #include <hyprland/src/managers/input/InputManager.hpp>
 #include <hyprland/src/managers/EventManager.hpp>
+#include <hyprland/src/managers/eventLoop/EventLoopManager.hpp>
 #include <hyprland/src/managers/LayoutManager.hpp>
 #include <hyprland/src/config/ConfigManager.hpp>
 #include <hyprland/src/config/ConfigValue.hpp>
@@ -46,14 +60,24 @@ int COrthoLayout::getNodeCountOnWorkspace(const WORKSPACEID &ws)
     return getSecondaryStackSize(ws) + getMainStackSize(ws);
 }
 
+// lookups must not insert, otherwise every queried workspace leaves an entry behind
 int COrthoLayout::getSecondaryStackSize(const WORKSPACEID &ws)
 {
-    return m_secondaryStackByWorkspace[ws].size();
+    const auto IT = m_secondaryStackByWorkspace.find(ws);
+    return IT == m_secondaryStackByWorkspace.end() ? 0 : IT->second.size();
 }
 
 int COrthoLayout::getMainStackSize(const WORKSPACEID &ws)
 {
-    return m_mainStackByWorkspace[ws].size();
+    const auto IT = m_mainStackByWorkspace.find(ws);
+    return IT == m_mainStackByWorkspace.end() ? 0 : IT->second.size();
+}
+
+// stoi and stod stop at the first character they can not parse, anything left over is a typo like 0.6x
+static void requireFullyConsumed(const std::string &value, size_t consumed)
+{
+    if (consumed != value.size())
+        throw std::invalid_argument("trailing characters");
 }
 
 std::optional<std::vector<double>> parseOverrideWeights(CVarList tokens, size_t start, size_t end)
@@ -64,7 +88,12 @@ std::optional<std::vector<double>> parseOverrideWeights(CVarList tokens, size_t
     {
         try
         {
-            float overrideWeight = std::stod(std::string{tokens[i]});
+            const std::string TOKEN{tokens[i]};
+            size_t consumed = 0;
+            float overrideWeight = std::stod(TOKEN, &consumed);
+            requireFullyConsumed(TOKEN, consumed);
+            if (!std::isfinite(overrideWeight))
+                throw std::invalid_argument("not finite");
             overrideWeights.push_back(overrideWeight);
         }
         catch (const std::invalid_argument &e)
@@ -87,15 +116,49 @@ std::optional<std::vector<double>> parseOverrideWeights(CVarList tokens)
     return parseOverrideWeights(tokens, size_t(0), tokens.size());
 }
 
-SOrthoWorkspaceData *COrthoLayout::getOrthoWorkspaceData(const WORKSPACEID &ws)
+// parses a single ortho setting into an override set, keys mirror the plugin:ortho: config names
+bool parseSettingsOverride(const std::string &key, const std::string &value, SOrthoSettingsOverride &settings)
 {
-    auto it = m_orthoWorkspaceDataByWorkspace.find(ws);
-    if (it != m_orthoWorkspaceDataByWorkspace.end())
+    try
     {
-        return &it->second;
+        size_t consumed = 0;
+        if (key == "main_stack_percent")
+        {
+            const double PERCENT = std::stod(value, &consumed);
+            requireFullyConsumed(value, consumed);
+            if (!std::isfinite(PERCENT))
+                throw std::invalid_argument("not finite");
+            settings.percMainStack = std::clamp(PERCENT, 0.1, 0.9);
+        }
+        else if (key == "main_stack_min")
+        {
+            const int MIN = std::stoi(value, &consumed);
+            requireFullyConsumed(value, consumed);
+            settings.mainStackMin = std::max(MIN, 1);
+        }
+        else if (key == "main_stack_side" && (value == "left" || value == "right"))
+            settings.mainSide = value == "right" ? MAIN_SIDE_RIGHT : MAIN_SIDE_LEFT;
+        else if (key == "main_weight_overrides")
+        {
+            const auto RESULT = parseOverrideWeights(CVarList(value, 0, ' '));
+            if (!RESULT.has_value())
+                return false;
+            settings.mainWeightOverrides = *RESULT;
+        }
+        else
+            return false;
+    }
+    catch (const std::exception &e)
+    {
+        Debug::log(ERR, "[ortho] invalid value {} for {}: {}", value, key, e.what());
+        return false;
     }
 
-    // create on the fly if it doesn't exist yet
+    return true;
+}
+
+void COrthoLayout::compileSettings()
+{
     static auto PMAINSIDE = CConfigValue<std::string>("plugin:ortho:main_stack_side");
     static auto PMAINPERCENT = CConfigValue<Hyprlang::FLOAT>("plugin:ortho:main_stack_percent");
     static auto PMAINSTACKMIN = CConfigValue<Hyprlang::INT>("plugin:ortho:main_stack_min");
@@ -104,9 +167,9 @@ SOrthoWorkspaceData *COrthoLayout::getOrthoWorkspaceData(const WORKSPACEID &ws)
     SOrthoWorkspaceData workspaceData;
     // comes in as quoted csv
     auto weights = std::string(*PMAINSTACKOVERRIDES);
-    const auto RESULT = parseOverrideWeights(CVarList(weights.substr(1, weights.length() - 2), 0, ','));
+    const auto RESULT = parseOverrideWeights(CVarList(weights.length() >= 2 ? weights.substr(1, weights.length() - 2) : "", 0, ','));
 
-    if (RESULT.has_value())
+    if (RESULT.has_value() && !RESULT->empty())
     {
         workspaceData.overrideMainWeights = true;
         workspaceData.mainWeightOverrides = *RESULT;
@@ -123,799 +186,3112 @@ SOrthoWorkspaceData *COrthoLayout::getOrthoWorkspaceData(const WORKSPACEID &ws)
         workspaceData.mainSide = MAIN_SIDE_LEFT;
 
     workspaceData.percMainStack = std::clamp(*PMAINPERCENT, 0.1f, 0.9f);
-    workspaceData.workspaceID = ws;
     workspaceData.mainStackMin = *PMAINSTACKMIN <= 0 ? 1 : *PMAINSTACKMIN;
-    m_orthoWorkspaceDataByWorkspace[ws] = workspaceData;
-    return &m_orthoWorkspaceDataByWorkspace[ws];
+
+    m_defaultWorkspaceData = workspaceData;
+    m_resolvedSettingsByWorkspace.clear();
+    m_settingsCompiled = true;
 }
 
-std::string COrthoLayout::getLayoutName()
+std::optional<std::string> COrthoLayout::addMonitorRule(const std::string &rule)
 {
-    return "OrthoStack";
+    // NAME, key:value, key:value...
+    CVarList tokens(rule, 0, ',');
+    if (tokens.size() < 2 || tokens[0].empty())
+        return "expected a monitor name followed by key:value pairs";
+
+    SOrthoSettingsOverride settings;
+    for (size_t i = 1; i < tokens.size(); ++i)
+    {
+        const auto SEPARATOR = tokens[i].find(':');
+        if (SEPARATOR == std::string::npos || !parseSettingsOverride(tokens[i].substr(0, SEPARATOR), tokens[i].substr(SEPARATOR + 1), settings))
+            return std::format("invalid ortho monitor setting {}", tokens[i]);
+    }
+
+    m_monitorRules[tokens[0]] = settings;
+    m_settingsCompiled = false;
+    return std::nullopt;
 }
 
-SOrthoNodeData *COrthoLayout::getMainStackTop(const WORKSPACEID &ws)
+void COrthoLayout::clearConfigRules()
 {
+    m_monitorRules.clear();
+    m_placementRules.clear();
+    m_settingsCompiled = false;
+}
 
-    auto mainStack = m_mainStackByWorkspace[ws];
+// regexes may contain commas themselves, e.g. a{2,3}, so a comma only ends a setting when a known key
+// follows it. a regex can still not contain a comma directly followed by one of the keys.
+static std::vector<std::string> splitPlacementRule(const std::string &rule)
+{
+    static constexpr std::array KEYS = {"class:", "title:", "stack:", "position:", "weight:"};
+    const auto trim = [](const std::string &str)
+    {
+        const auto FIRST = str.find_first_not_of(" \t");
+        return FIRST == std::string::npos ? std::string{} : str.substr(FIRST, str.find_last_not_of(" \t") - FIRST + 1);
+    };
 
-    if (mainStack.empty())
+    std::vector<std::string> tokens;
+    size_t start = 0;
+    while (true)
     {
-        return nullptr;
+        const auto COMMA = rule.find(',', start);
+        const auto PIECE = rule.substr(start, COMMA == std::string::npos ? std::string::npos : COMMA - start);
+        const auto TRIMMED = trim(PIECE);
+        if (tokens.empty() || std::ranges::any_of(KEYS, [&](const char *key) { return TRIMMED.starts_with(key); }))
+            tokens.push_back(PIECE);
+        else
+            tokens.back() += "," + PIECE;
+
+        if (COMMA == std::string::npos)
+            break;
+        start = COMMA + 1;
     }
 
-    return &mainStack.back();
+    for (auto &token : tokens)
+    {
+        token = trim(token);
+    }
+    return tokens;
 }
 
-SOrthoNodeData *COrthoLayout::getSecondaryStackTop(const WORKSPACEID &ws)
+std::optional<std::string> COrthoLayout::addPlacementRule(const std::string &rule)
 {
+    // class:REGEX, title:REGEX, stack:main|secondary, position:top|bottom|afterfocused, weight:W
+    const auto tokens = splitPlacementRule(rule);
 
-    auto secondaryStack = m_secondaryStackByWorkspace[ws];
+    SOrthoPlacementRule placement;
+    for (const auto &token : tokens)
+    {
+        const auto SEPARATOR = token.find(':');
+        if (SEPARATOR == std::string::npos)
+            return std::format("expected key:value, got {}", token);
 
-    if (secondaryStack.empty())
+        const auto KEY = token.substr(0, SEPARATOR);
+        const auto VALUE = token.substr(SEPARATOR + 1);
+
+        try
+        {
+            if (KEY == "class")
+                placement.windowClass = std::regex(VALUE, std::regex::optimize);
+            else if (KEY == "title")
+                placement.title = std::regex(VALUE, std::regex::optimize);
+            else if (KEY == "stack" && (VALUE == "main" || VALUE == "secondary"))
+                placement.stack = VALUE == "main" ? ORTHOSTATUS_MAIN : ORTHOSTATUS_SECONDARY;
+            else if (KEY == "position" && VALUE == "top")
+                placement.position = ORTHOINSERT_TOP;
+            else if (KEY == "position" && VALUE == "bottom")
+                placement.position = ORTHOINSERT_BOTTOM;
+            else if (KEY == "position" && VALUE == "afterfocused")
+                placement.position = ORTHOINSERT_AFTER_FOCUSED;
+            else if (KEY == "weight")
+            {
+                size_t consumed = 0;
+                placement.weight = std::stod(VALUE, &consumed);
+                requireFullyConsumed(VALUE, consumed);
+                // a node without weight gets no space at all, and inf or nan would poison the whole stack
+                if (!std::isfinite(placement.weight) || placement.weight <= 0)
+                    return std::format("ortho placement weight must be positive, got {}", VALUE);
+            }
+            else
+                return std::format("invalid ortho placement setting {}", token);
+        }
+        catch (const std::exception &e)
+        {
+            return std::format("invalid ortho placement setting {}: {}", token, e.what());
+        }
+    }
+
+    if (!placement.windowClass && !placement.title)
+        return "an ortho placement rule needs a class or a title";
+
+    m_placementRules.push_back(std::move(placement));
+    return std::nullopt;
+}
+
+const SOrthoPlacementRule *COrthoLayout::getPlacementRuleFor(PHLWINDOW pWindow)
+{
+    // rules were compiled when the config was parsed, the first match wins
+    for (const auto &rule : m_placementRules)
     {
-        return nullptr;
+        if (rule.windowClass && !std::regex_search(pWindow->m_class, *rule.windowClass))
+            continue;
+        if (rule.title && !std::regex_search(pWindow->m_title, *rule.title))
+            continue;
+        return &rule;
     }
 
-    return &secondaryStack.back();
+    return nullptr;
 }
 
-void COrthoLayout::onWindowCreatedTiling(PHLWINDOW pWindow, eDirection direction)
+const SOrthoWorkspaceData &COrthoLayout::resolveSettings(const WORKSPACEID &ws, PHLMONITOR pMonitor)
 {
-    if (pWindow->m_isFloating)
-        return;
+    if (!m_settingsCompiled)
+        compileSettings();
 
-    const auto PMONITOR = pWindow->m_monitor.lock();
-    const auto PWORKSPACEID = pWindow->workspaceID();
+    const MONITORID MONITOR = pMonitor ? pMonitor->m_id : MONITOR_INVALID;
 
-    static auto PMAINSTACKMIN = CConfigValue<Hyprlang::INT>("plugin:ortho:main_stack_min");
-    const int mainStackMinimum = *PMAINSTACKMIN >= 1 ? *PMAINSTACKMIN : 1;
+    const auto IT = m_resolvedSettingsByWorkspace.find({ws, MONITOR});
+    if (IT != m_resolvedSettingsByWorkspace.end())
+        return IT->second;
 
-    const auto PORTHOWORKSPACEDATA = getOrthoWorkspaceData(PWORKSPACEID);
+    // miss: walk the rules once, every later lookup for this workspace and monitor is a table hit
+    SOrthoWorkspaceData resolved = m_defaultWorkspaceData;
+    resolved.workspaceID = ws;
+    resolved.monitorID = MONITOR;
 
-    SOrthoNodeData node{
-        .pWindow = pWindow,
-    };
+    if (pMonitor)
+    {
+        if (const auto RULE = m_monitorRules.find(pMonitor->m_name); RULE != m_monitorRules.end())
+            RULE->second.applyTo(resolved);
+    }
 
-    // add to mainStack if not yet satisfied
-    if (getMainStackSize(PWORKSPACEID) < mainStackMinimum)
+    // workspace rules win over monitor rules, e.g. workspace = 3, layoutopt:ortho_main_stack_percent:0.6
+    if (const auto PWORKSPACE = g_pCompositor->getWorkspaceByID(ws))
     {
-        m_mainStackByWorkspace[PWORKSPACEID].push_back(node);
+        SOrthoSettingsOverride settings;
+        for (const auto &[key, value] : g_pConfigManager->getWorkspaceRuleFor(PWORKSPACE).layoutopts)
+        {
+            if (key.starts_with("ortho_") && !parseSettingsOverride(key.substr(6), value, settings))
+                Debug::log(ERR, "[ortho] invalid workspace layoutopt {}:{}", key, value);
+        }
+        settings.applyTo(resolved);
     }
-    else
+
+    return m_resolvedSettingsByWorkspace[{ws, MONITOR}] = resolved;
+}
+
+void SOrthoSettingsOverride::applyTo(SOrthoWorkspaceData &workspaceData) const
+{
+    if (percMainStack)
+        workspaceData.percMainStack = *percMainStack;
+    if (mainStackMin)
+        workspaceData.mainStackMin = *mainStackMin;
+    if (mainSide)
+        workspaceData.mainSide = *mainSide;
+    if (mainWeightOverrides)
     {
-        m_secondaryStackByWorkspace[PWORKSPACEID].push_back(node);
+        workspaceData.mainWeightOverrides = *mainWeightOverrides;
+        workspaceData.overrideMainWeights = !mainWeightOverrides->empty();
     }
-    recalculateMonitor(pWindow->monitorID());
-    pWindow->m_workspace->updateWindows();
 }
 
-void COrthoLayout::onWindowRemovedTiling(PHLWINDOW pWindow)
+void SOrthoWorkspaceData::applySettings(const SOrthoWorkspaceData &settings)
 {
-    auto result = getNodeFromWindow(pWindow);
-    if (!result.has_value())
+    if (!percMainStackSetAtRuntime)
+        percMainStack = settings.percMainStack;
+    mainStackMin = settings.mainStackMin;
+    if (!mainSideSetAtRuntime)
+        mainSide = settings.mainSide;
+    if (!mainWeightsSetAtRuntime)
     {
-        return;
+        mainWeightOverrides = settings.mainWeightOverrides;
+        overrideMainWeights = settings.overrideMainWeights;
     }
+    monitorID = settings.monitorID;
+}
 
-    const auto &[nd, ws, status] = *result;
+SOrthoWorkspaceData *COrthoLayout::getOrthoWorkspaceData(const WORKSPACEID &ws)
+{
+    auto it = m_orthoWorkspaceDataByWorkspace.find(ws);
+    if (it != m_orthoWorkspaceDataByWorkspace.end())
+    {
+        return &it->second;
+    }
 
-    auto &MAINSTACK = m_mainStackByWorkspace[ws];
-    auto &SECONDARYSTACK = m_secondaryStackByWorkspace[ws];
-    static auto PMAINSTACKMIN = CConfigValue<Hyprlang::INT>("plugin:ortho:main_stack_min");
-    pWindow->m_ruleApplicator->resetProps(Desktop::Rule::RULE_PROP_ALL, Desktop::Types::PRIORITY_LAYOUT);
-    pWindow->updateWindowData();
+    // create on the fly if it doesn't exist yet
+    const auto PWORKSPACE = g_pCompositor->getWorkspaceByID(ws);
+
+    SOrthoWorkspaceData workspaceData;
+    workspaceData.workspaceID = ws;
+    workspaceData.applySettings(resolveSettings(ws, PWORKSPACE ? PWORKSPACE->m_monitor.lock() : nullptr));
+    m_orthoWorkspaceDataByWorkspace[ws] = workspaceData;
+    return &m_orthoWorkspaceDataByWorkspace[ws];
+}
+
+void COrthoLayout::onConfigReloaded()
+{
+    compileSettings();
 
-    if (status == ORTHOSTATUS_MAIN)
+    // rules feeding the window data may have changed
+    for (auto *stacks : {&m_mainStackByWorkspace, &m_secondaryStackByWorkspace})
     {
-        std::erase(MAINSTACK, *nd);
+        for (auto &[ws, nodes] : *stacks)
+        {
+            for (auto &nd : nodes)
+            {
+                nd.propsApplied = false;
+            }
+        }
     }
-    else
+
+    for (auto &[ws, _] : m_geometryCacheByWorkspace)
     {
-        std::erase(SECONDARYSTACK, *nd);
+        invalidateGeometryCache(ws);
     }
 
-    if (pWindow->isFullscreen())
-        g_pCompositor->setWindowFullscreenInternal(pWindow, FSMODE_NONE);
+    for (auto &[ws, workspaceData] : m_orthoWorkspaceDataByWorkspace)
+    {
+        const auto PWORKSPACE = g_pCompositor->getWorkspaceByID(ws);
+        workspaceData.applySettings(resolveSettings(ws, PWORKSPACE ? PWORKSPACE->m_monitor.lock() : nullptr));
+    }
 
-    if (status == ORTHOSTATUS_MAIN && MAINSTACK.size() < *PMAINSTACKMIN && !SECONDARYSTACK.empty())
+    for (auto const &m : g_pCompositor->m_monitors)
     {
-        MAINSTACK.push_back(SECONDARYSTACK.back());
-        SECONDARYSTACK.pop_back();
+        relayoutMonitor(m->m_id);
     }
-    recalculateMonitor(pWindow->monitorID());
-    pWindow->m_workspace->updateWindows();
 }
 
-void COrthoLayout::recalculateMonitor(const MONITORID &monid)
+std::string COrthoLayout::getLayoutName()
 {
-    const auto PMONITOR = g_pCompositor->getMonitorFromID(monid);
-
-    if (!PMONITOR || !PMONITOR->m_activeWorkspace)
-        return;
-
-    g_pHyprRenderer->damageMonitor(PMONITOR);
+    return "OrthoStack";
+}
 
-    if (PMONITOR->m_activeSpecialWorkspace)
-        calculateWorkspace(PMONITOR->m_activeSpecialWorkspace);
+SOrthoNodeData *COrthoLayout::getMainStackTop(const WORKSPACEID &ws)
+{
+    const auto IT = m_mainStackByWorkspace.find(ws);
 
-    calculateWorkspace(PMONITOR->m_activeWorkspace);
+    if (IT == m_mainStackByWorkspace.end() || IT->second.empty())
+    {
+        return nullptr;
+    }
 
-#ifndef NO_XWAYLAND
-    CBox box = g_pCompositor->calculateX11WorkArea();
-    if (!g_pXWayland || !g_pXWayland->m_wm)
-        return;
-    g_pXWayland->m_wm->updateWorkArea(box.x, box.y, box.w, box.h);
-#endif
+    return &IT->second.back();
 }
 
-void COrthoLayout::calculateWorkspace(PHLWORKSPACE pWorkspace)
+SOrthoNodeData *COrthoLayout::getSecondaryStackTop(const WORKSPACEID &ws)
 {
-    const auto PMONITOR = pWorkspace->m_monitor.lock();
-    const auto WSSIZE = PMONITOR->m_size - PMONITOR->m_reservedTopLeft - PMONITOR->m_reservedBottomRight;
-    const auto WSPOS = PMONITOR->m_position + PMONITOR->m_reservedTopLeft;
-    const auto WS = pWorkspace->m_id;
-    const auto WORKSPACEDATA = getOrthoWorkspaceData(WS);
-    const bool BISRIGHT = WORKSPACEDATA->mainSide == MAIN_SIDE_RIGHT;
-    const bool BOVERRIDEMAIN = WORKSPACEDATA->overrideMainWeights;
-    const auto OVERRIDEWEIGHTS = WORKSPACEDATA->mainWeightOverrides;
-    if (!PMONITOR)
-        return;
+    const auto IT = m_secondaryStackByWorkspace.find(ws);
 
-    if (pWorkspace->m_hasFullscreenWindow)
+    if (IT == m_secondaryStackByWorkspace.end() || IT->second.empty())
     {
-        // massive hack from the fullscreen func
-        const auto PFULLWINDOW = pWorkspace->getFullscreenWindow();
+        return nullptr;
+    }
 
-        if (pWorkspace->m_fullscreenMode == FSMODE_FULLSCREEN)
-        {
-            *PFULLWINDOW->m_realPosition = PMONITOR->m_position;
-            *PFULLWINDOW->m_realSize = PMONITOR->m_size;
-        }
-        else if (pWorkspace->m_fullscreenMode == FSMODE_MAXIMIZED)
-        {
-            SOrthoNodeData fakeNode;
-            fakeNode.pWindow = PFULLWINDOW;
-            fakeNode.position = PMONITOR->m_position + PMONITOR->m_reservedTopLeft;
-            fakeNode.size = PMONITOR->m_size - PMONITOR->m_reservedTopLeft - PMONITOR->m_reservedBottomRight;
-            PFULLWINDOW->m_position = fakeNode.position;
-            PFULLWINDOW->m_size = fakeNode.size;
-            fakeNode.ignoreFullscreenChecks = true;
+    return &IT->second.back();
+}
 
-            applyNodeDataToWindow(&fakeNode, pWorkspace->m_id);
-        }
+void COrthoLayout::onWorkspaceDestroyed(const WORKSPACEID &ws)
+{
+    // windows are gone by the time a workspace is destroyed, anything left is a leak
+    if (getNodeCountOnWorkspace(ws) > 0)
+        Debug::log(ERR, "[ortho] workspace {} destroyed with {} nodes left", ws, getNodeCountOnWorkspace(ws));
+
+    m_mainStackByWorkspace.erase(ws);
+    m_secondaryStackByWorkspace.erase(ws);
+    m_orthoWorkspaceDataByWorkspace.erase(ws);
+    std::erase_if(m_resolvedSettingsByWorkspace, [&](const auto &entry) { return entry.first.first == ws; });
+    m_dirtyWorkspaces.erase(ws);
+    std::erase_if(m_tombstones, [&](const auto &t) { return t.ws == ws; });
+    m_lastEmittedEvents.erase(ws);
+    m_pendingEventWorkspaces.erase(ws);
+    m_pendingWindowUpdates.erase(ws);
+    m_pendingCommitsByWorkspace.erase(ws);
+    m_frozenMovedWindows.erase(ws);
+    m_geometryCacheByWorkspace.erase(ws);
+
+    // no commit follows for a destroyed workspace, drop it from the table here
+    m_shmDirty = true;
+    schedulePostPassFlush();
+}
 
-        // if has fullscreen, don't calculate the rest
-        return;
-    }
-    auto &MAINSTACK = m_mainStackByWorkspace[WS];
-    auto &SECONDARYSTACK = m_secondaryStackByWorkspace[WS];
+void COrthoLayout::markLayoutChanged(const WORKSPACEID &ws)
+{
+    m_pendingEventWorkspaces.insert(ws);
+    schedulePostPassFlush();
+}
 
-    if (MAINSTACK.empty())
+void COrthoLayout::schedulePostPassFlush()
+{
+    if (m_postPassFlushScheduled)
         return;
 
-    // calculate the main stack
-    double widthToSplit = SECONDARYSTACK.empty() ? WSSIZE.x : WSSIZE.x * WORKSPACEDATA->percMainStack;
-    double totalWeight = 0.0;             // each master is guaranteed to have a weight greater than 0
-    double remainingWidth = widthToSplit; // take care of rounding errors in the last window
+    m_postPassFlushScheduled = true;
+
+    // runs once the current burst of layout calls has been dispatched
+    g_pEventLoopManager->doLater([token = WP<bool>(m_lifetimeToken), this]()
+                                 {
+        if (token.expired())
+            return;
+        m_postPassFlushScheduled = false;
+        flushPostPass(); });
+}
+
+void COrthoLayout::flushPostPass()
+{
+    m_fullscreenExitCommitted.clear();
 
-    if (!BOVERRIDEMAIN)
+    for (const auto &ws : m_pendingWindowUpdates)
     {
-        for (auto &nd : MAINSTACK)
-        {
-            totalWeight += nd.weight;
-        }
+        if (const auto PWORKSPACE = g_pCompositor->getWorkspaceByID(ws))
+            PWORKSPACE->updateWindows();
     }
-    else
+    m_pendingWindowUpdates.clear();
+
+    if (m_x11WorkAreaDirty)
     {
-        for (int i = 0; i < std::min(OVERRIDEWEIGHTS.size(), MAINSTACK.size()); ++i)
-        {
-            totalWeight += OVERRIDEWEIGHTS[i];
-        }
-        if (OVERRIDEWEIGHTS.size() < MAINSTACK.size())
-            totalWeight += MAINSTACK.size() - OVERRIDEWEIGHTS.size();
+        m_x11WorkAreaDirty = false;
+        updateX11WorkArea();
     }
-    // bottom of main stack is right next to the secondary stack
-    // iteration is happening in reverse stack order
-    // start drawing from the inside
 
-    double nextX = BISRIGHT ? WSSIZE.x - widthToSplit : widthToSplit;
-    auto weights_it = OVERRIDEWEIGHTS.begin();
+    for (const auto &ws : m_pendingEventWorkspaces)
+    {
+        emitLayoutEvents(ws);
+    }
+    m_pendingEventWorkspaces.clear();
 
-    for (auto &nd : MAINSTACK)
+    if (m_shmDirty)
     {
-        const double WEIGHT = !BOVERRIDEMAIN ? nd.weight : weights_it == OVERRIDEWEIGHTS.end() ? 1
-                                                                                               : *weights_it;
-        const double WIDTH = std::min(widthToSplit * WEIGHT / totalWeight, remainingWidth);
+        m_shmDirty = false;
+        publishShm();
+    }
+}
 
-        if (!BISRIGHT)
-            nextX -= WIDTH;
+bool COrthoLayout::openShmExport()
+{
+    const auto SIGNATURE = getenv("HYPRLAND_INSTANCE_SIGNATURE");
+    if (!SIGNATURE || !*SIGNATURE)
+        return false;
 
-        nd.size = Vector2D(WIDTH, WSSIZE.y);
-        nd.position = WSPOS + Vector2D(nextX, 0.0);
+    m_shmName = std::string{ORTHO_SHM_NAME_PREFIX} + SIGNATURE;
 
-        if (BISRIGHT)
-            nextX += WIDTH;
+    const int FD = shm_open(m_shmName.c_str(), O_CREAT | O_RDWR, 0600);
+    if (FD < 0)
+    {
+        Debug::log(ERR, "[ortho] shm_open {} failed: {}", m_shmName, strerror(errno));
+        return false;
+    }
+
+    void *mapping = MAP_FAILED;
+    if (ftruncate(FD, sizeof(SOrthoShmTable)) == 0)
+        mapping = mmap(nullptr, sizeof(SOrthoShmTable), PROT_READ | PROT_WRITE, MAP_SHARED, FD, 0);
+    // the mapping keeps the object alive
+    close(FD);
 
-        remainingWidth -= WIDTH;
-        applyNodeDataToWindow(&nd, pWorkspace->m_id);
-        if (weights_it != OVERRIDEWEIGHTS.end())
-            ++weights_it;
+    if (mapping == MAP_FAILED)
+    {
+        Debug::log(ERR, "[ortho] mapping {} failed: {}", m_shmName, strerror(errno));
+        shm_unlink(m_shmName.c_str());
+        return false;
     }
 
-    if (SECONDARYSTACK.empty())
+    m_shmTable = sc<SOrthoShmTable *>(mapping);
+    memset(m_shmTable, 0, sizeof(SOrthoShmTable));
+    m_shmTable->version = ORTHO_SHM_VERSION;
+    m_shmTable->size = sizeof(SOrthoShmTable);
+    // readers check the magic first, so it goes in last
+    __atomic_store_n(&m_shmTable->magic, ORTHO_SHM_MAGIC, __ATOMIC_RELEASE);
+    return true;
+}
+
+void COrthoLayout::closeShmExport()
+{
+    if (!m_shmTable)
         return;
 
-    totalWeight = 0.0;
+    __atomic_store_n(&m_shmTable->magic, 0, __ATOMIC_RELEASE);
+    munmap(m_shmTable, sizeof(SOrthoShmTable));
+    shm_unlink(m_shmName.c_str());
+    m_shmTable = nullptr;
+}
 
-    for (auto &nd : SECONDARYSTACK)
+void COrthoLayout::publishShm()
+{
+    static auto PSHMEXPORT = CConfigValue<Hyprlang::INT>("plugin:ortho:shm_export");
+    if (!*PSHMEXPORT)
     {
-        totalWeight += nd.weight;
+        closeShmExport();
+        return;
     }
 
-    // secondary stack is top of stack on top of screen
-    // start drawing from the bottom
-    nextX = BISRIGHT ? 0 : widthToSplit;
-    double nextY = WSSIZE.y;
-    const double WIDTH = WSSIZE.x - widthToSplit;
-    const double remainingHeight = WSSIZE.y;
-    for (auto &nd : SECONDARYSTACK)
-    {
-        const double HEIGHT = std::min(WSSIZE.y * nd.weight / totalWeight, remainingHeight);
-        nextY -= HEIGHT;
+    if (!m_shmTable && !openShmExport())
+        return;
 
-        nd.size = Vector2D(WIDTH, HEIGHT);
-        nd.position = WSPOS + Vector2D(nextX, nextY);
+    std::vector<WORKSPACEID> workspaces;
+    for (const auto &[ws, _] : m_orthoWorkspaceDataByWorkspace)
+    {
+        workspaces.push_back(ws);
+    }
+    std::ranges::sort(workspaces);
+
+    auto *table = m_shmTable;
+    const auto SEQUENCE = __atomic_load_n(&table->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&table->sequence, SEQUENCE + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    table->flags = 0;
+    uint32_t workspaceCount = 0;
+    uint32_t nodeCount = 0;
+    const std::deque<SOrthoNodeData> EMPTY;
+    for (const auto &ws : workspaces)
+    {
+        const auto MAINIT = m_mainStackByWorkspace.find(ws);
+        const auto SECONDARYIT = m_secondaryStackByWorkspace.find(ws);
+        const auto &MAINSTACK = MAINIT == m_mainStackByWorkspace.end() ? EMPTY : MAINIT->second;
+        const auto &SECONDARYSTACK = SECONDARYIT == m_secondaryStackByWorkspace.end() ? EMPTY : SECONDARYIT->second;
+        if (workspaceCount == ORTHO_SHM_MAX_WORKSPACES || nodeCount + MAINSTACK.size() + SECONDARYSTACK.size() > ORTHO_SHM_MAX_NODES)
+        {
+            table->flags |= ORTHO_SHM_FLAG_TRUNCATED;
+            break;
+        }
 
-        applyNodeDataToWindow(&nd, pWorkspace->m_id);
+        const auto &WSDATA = m_orthoWorkspaceDataByWorkspace.at(ws);
+        table->workspaces[workspaceCount++] = SOrthoShmWorkspace{
+            .id = ws,
+            .percMainStack = WSDATA.percMainStack,
+            .firstNode = nodeCount,
+            .mainCount = sc<uint32_t>(MAINSTACK.size()),
+            .secondaryCount = sc<uint32_t>(SECONDARYSTACK.size()),
+            .mainSide = sc<uint8_t>(WSDATA.mainSide),
+        };
+
+        for (const auto &[stack, stackType] : {std::pair{&MAINSTACK, ORTHO_SHM_STACK_MAIN}, std::pair{&SECONDARYSTACK, ORTHO_SHM_STACK_SECONDARY}})
+        {
+            for (size_t i = 0; i < stack->size(); ++i)
+            {
+                const auto &nd = (*stack)[i];
+                const auto PWINDOW = nd.pWindow.lock();
+                const auto POS = PWINDOW ? PWINDOW->m_realPosition->goal() : Vector2D{};
+                const auto SIZE = PWINDOW ? PWINDOW->m_realSize->goal() : Vector2D{};
+                table->nodes[nodeCount++] = SOrthoShmNode{
+                    .window = rc<uintptr_t>(PWINDOW.get()),
+                    .x = POS.x,
+                    .y = POS.y,
+                    .w = SIZE.x,
+                    .h = SIZE.y,
+                    .weight = nd.weight,
+                    .index = sc<uint32_t>(i),
+                    .stack = sc<uint8_t>(stackType),
+                    .collapsed = nd.collapsed,
+                };
+            }
+        }
     }
+    table->workspaceCount = workspaceCount;
+    table->nodeCount = nodeCount;
+
+    __atomic_store_n(&table->sequence, SEQUENCE + 2, __ATOMIC_RELEASE);
 }
 
-void COrthoLayout::applyNodeDataToWindow(SOrthoNodeData *pNode, const WORKSPACEID &ws)
+void COrthoLayout::emitLayoutEvents(const WORKSPACEID &ws)
 {
-    PHLMONITOR PMONITOR = nullptr;
+    const auto WSDATA = m_orthoWorkspaceDataByWorkspace.find(ws);
+    if (WSDATA == m_orthoWorkspaceDataByWorkspace.end())
+        return;
 
-    if (g_pCompositor->isWorkspaceSpecial(ws))
+    std::string stacks[2];
+    std::string weights[2];
+    const std::array STACKSBYWORKSPACE = {&m_mainStackByWorkspace, &m_secondaryStackByWorkspace};
+    for (size_t i = 0; i < STACKSBYWORKSPACE.size(); ++i)
     {
-        for (auto const &m : g_pCompositor->m_monitors)
+        const auto IT = STACKSBYWORKSPACE[i]->find(ws);
+        if (IT == STACKSBYWORKSPACE[i]->end())
+            continue;
+
+        for (const auto &nd : IT->second)
         {
-            if (m->activeSpecialWorkspaceID() == ws)
-            {
-                PMONITOR = m;
-                break;
-            }
+            stacks[i] += std::format("{}0x{:x}", stacks[i].empty() ? "" : " ", rc<uintptr_t>(nd.pWindow.lock().get()));
+            weights[i] += std::format("{}{}", weights[i].empty() ? "" : " ", nd.weight);
         }
     }
-    else
-        PMONITOR = g_pCompositor->getWorkspaceByID(ws)->m_monitor.lock();
 
-    if (!PMONITOR)
+    std::string overrides;
+    if (WSDATA->second.overrideMainWeights)
     {
-        Debug::log(ERR, "Orphaned Node {}!!", pNode);
-        return;
+        for (const auto &w : WSDATA->second.mainWeightOverrides)
+        {
+            overrides += std::format("{}{}", overrides.empty() ? "" : " ", w);
+        }
     }
 
-    // for gaps outer
-    const bool DISPLAYLEFT = STICKS(pNode->position.x, PMONITOR->m_position.x + PMONITOR->m_reservedTopLeft.x);
-    const bool DISPLAYRIGHT = STICKS(pNode->position.x + pNode->size.x, PMONITOR->m_position.x + PMONITOR->m_size.x - PMONITOR->m_reservedBottomRight.x);
-    const bool DISPLAYTOP = STICKS(pNode->position.y, PMONITOR->m_position.y + PMONITOR->m_reservedTopLeft.y);
-    const bool DISPLAYBOTTOM = STICKS(pNode->position.y + pNode->size.y, PMONITOR->m_position.y + PMONITOR->m_size.y - PMONITOR->m_reservedBottomRight.y);
+    const auto STACKEVENT = std::format("{},{},{}", ws, stacks[0], stacks[1]);
+    const auto WEIGHTSEVENT = std::format("{},{},{},{},{},{}", ws, weights[0], weights[1], overrides, WSDATA->second.percMainStack,
+                                          WSDATA->second.mainSide == MAIN_SIDE_RIGHT ? "right" : "left");
 
-    const auto PWINDOW = pNode->pWindow.lock();
-    // get specific gaps and rules for this workspace,
-    // if user specified them in config
-    const auto WORKSPACERULE = g_pConfigManager->getWorkspaceRuleFor(PWINDOW->m_workspace);
+    // re-applying an unchanged layout stays silent
+    auto &last = m_lastEmittedEvents[ws];
 
-    if (PWINDOW->isFullscreen() && !pNode->ignoreFullscreenChecks)
-        return;
+    if (last.stack != STACKEVENT)
+    {
+        g_pEventManager->postEvent(SHyprIPCEvent{"orthostack", STACKEVENT});
+        last.stack = STACKEVENT;
+    }
 
-    PWINDOW->m_ruleApplicator->resetProps(Desktop::Rule::RULE_PROP_ALL, Desktop::Types::PRIORITY_LAYOUT);
-    PWINDOW->updateWindowData();
+    if (last.weights != WEIGHTSEVENT)
+    {
+        g_pEventManager->postEvent(SHyprIPCEvent{"orthoweights", WEIGHTSEVENT});
+        last.weights = WEIGHTSEVENT;
+    }
+}
 
-    static auto PANIMATE = CConfigValue<Hyprlang::INT>("misc:animate_manual_resizes");
-    static auto PGAPSINDATA = CConfigValue<Hyprlang::CUSTOMTYPE>("general:gaps_in");
-    static auto PGAPSOUTDATA = CConfigValue<Hyprlang::CUSTOMTYPE>("general:gaps_out");
-    auto *PGAPSIN = sc<CCssGapData *>((PGAPSINDATA.ptr())->getData());
-    auto *PGAPSOUT = sc<CCssGapData *>((PGAPSOUTDATA.ptr())->getData());
+std::vector<std::string> COrthoLayout::checkInvariants(const WORKSPACEID &ws)
+{
+    std::vector<std::string> violations;
 
-    auto gapsIn = WORKSPACERULE.gapsIn.value_or(*PGAPSIN);
-    auto gapsOut = WORKSPACERULE.gapsOut.value_or(*PGAPSOUT);
+    const auto MAINSIZE = getMainStackSize(ws);
+    const auto SECONDARYSIZE = getSecondaryStackSize(ws);
+    const auto WSDATA = m_orthoWorkspaceDataByWorkspace.find(ws);
+    const int MAINSTACKMIN = WSDATA == m_orthoWorkspaceDataByWorkspace.end() ? 1 : WSDATA->second.mainStackMin;
 
-    if (!validMapped(PWINDOW))
+    // the main stack may only be short of its minimum if there is nothing left to promote,
+    // or by the main nodes that were floated and keep their slot
+    const auto PARKEDMAIN = std::ranges::count_if(m_tombstones, [&](const auto &t) { return t.ws == ws && t.status == ORTHOSTATUS_MAIN && !t.pWindow.expired(); });
+    if (MAINSIZE + PARKEDMAIN < MAINSTACKMIN && SECONDARYSIZE > 0)
+        violations.push_back(std::format("main stack has {} nodes, minimum is {} with {} secondary nodes", MAINSIZE, MAINSTACKMIN, SECONDARYSIZE));
+
+    const auto checkStack = [&](const std::unordered_map<WORKSPACEID, std::deque<SOrthoNodeData>> &stacks, const char *name)
     {
-        Debug::log(ERR, "Node {} holding invalid {}!!", pNode, PWINDOW);
-        return;
-    }
+        const auto IT = stacks.find(ws);
+        if (IT == stacks.end())
+            return;
 
-    PWINDOW->m_size = pNode->size;
-    PWINDOW->m_position = pNode->position;
+        for (const auto &nd : IT->second)
+        {
+            const auto PWINDOW = nd.pWindow.lock();
+            if (!PWINDOW)
+                violations.push_back(std::format("{} stack holds an orphaned node", name));
+            else if (PWINDOW->workspaceID() != ws)
+                violations.push_back(std::format("{} stack holds {:x} which lives on workspace {}", name, rc<uintptr_t>(PWINDOW.get()), PWINDOW->workspaceID()));
+            else if (const auto RESULT = getNodeFromWindow(PWINDOW); !RESULT.has_value() || RESULT->nd != &nd)
+                violations.push_back(std::format("{} stack holds {:x} more than once", name, rc<uintptr_t>(PWINDOW.get())));
+        }
+    };
 
-    PWINDOW->updateWindowDecos();
+    checkStack(m_mainStackByWorkspace, "main");
+    checkStack(m_secondaryStackByWorkspace, "secondary");
 
-    auto calcPos = PWINDOW->m_position;
-    auto calcSize = PWINDOW->m_size;
+    return violations;
+}
 
-    const auto OFFSETTOPLEFT = Vector2D(sc<double>(DISPLAYLEFT ? gapsOut.m_left : gapsIn.m_left), sc<double>(DISPLAYTOP ? gapsOut.m_top : gapsIn.m_top));
+void COrthoLayout::debugCheckInvariants(const WORKSPACEID &ws)
+{
+    static auto PDEBUGINVARIANTS = CConfigValue<Hyprlang::INT>("plugin:ortho:debug_invariants");
+    if (!*PDEBUGINVARIANTS)
+        return;
 
-    const auto OFFSETBOTTOMRIGHT = Vector2D(sc<double>(DISPLAYRIGHT ? gapsOut.m_right : gapsIn.m_right), sc<double>(DISPLAYBOTTOM ? gapsOut.m_bottom : gapsIn.m_bottom));
+    for (const auto &violation : checkInvariants(ws))
+    {
+        Debug::log(ERR, "[ortho] invariant violated on workspace {}: {}", ws, violation);
+    }
+}
 
-    calcPos = calcPos + OFFSETTOPLEFT;
-    calcSize = calcSize - OFFSETTOPLEFT - OFFSETBOTTOMRIGHT;
+void COrthoLayout::onWindowCreatedTiling(PHLWINDOW pWindow, eDirection direction)
+{
+    if (pWindow->m_isFloating)
+        return;
 
-    const auto RESERVED = PWINDOW->getFullWindowReservedArea();
-    calcPos = calcPos + RESERVED.topLeft;
-    calcSize = calcSize - (RESERVED.topLeft + RESERVED.bottomRight);
+    if (m_floatToggle && restoreFromTombstone(pWindow))
+        return;
 
-    Vector2D availableSpace = calcSize;
+    const auto PMONITOR = pWindow->m_monitor.lock();
+    const auto PWORKSPACEID = pWindow->workspaceID();
 
-    static auto PCLAMP_TILED = CConfigValue<Hyprlang::INT>("misc:size_limits_tiled");
+    const auto PORTHOWORKSPACEDATA = getOrthoWorkspaceData(PWORKSPACEID);
+    const int mainStackMinimum = PORTHOWORKSPACEDATA->mainStackMin;
 
-    if (*PCLAMP_TILED)
-    {
-        const auto borderSize = PWINDOW->getRealBorderSize();
-        Vector2D monitorAvailable = PMONITOR->m_size - PMONITOR->m_reservedTopLeft - PMONITOR->m_reservedBottomRight -
-                                    Vector2D{(double)(gapsOut.m_left + gapsOut.m_right), (double)(gapsOut.m_top + gapsOut.m_bottom)} - Vector2D{2.0 * borderSize, 2.0 * borderSize};
+    SOrthoNodeData node{
+        .pWindow = pWindow,
+    };
 
-        Vector2D minSize = PWINDOW->m_ruleApplicator->minSize().valueOr(Vector2D{MIN_WINDOW_SIZE, MIN_WINDOW_SIZE}).clamp(Vector2D{0, 0}, monitorAvailable);
-        Vector2D maxSize = PWINDOW->isFullscreen() ? Vector2D{INFINITY, INFINITY} : PWINDOW->m_ruleApplicator->maxSize().valueOr(Vector2D{INFINITY, INFINITY}).clamp(Vector2D{0, 0}, monitorAvailable);
-        calcSize = calcSize.clamp(minSize, maxSize);
+    const auto PRULE = getPlacementRuleFor(pWindow);
+    if (PRULE)
+        node.weight = PRULE->weight;
 
-        calcPos += (availableSpace - calcSize) / 2.0;
+    // a workspace with nodes always has both stacks, even while one of them is empty
+    m_mainStackByWorkspace.try_emplace(PWORKSPACEID);
+    m_secondaryStackByWorkspace.try_emplace(PWORKSPACEID);
 
-        calcPos.x = std::clamp(calcPos.x, PMONITOR->m_position.x + PMONITOR->m_reservedTopLeft.x + gapsOut.m_left + borderSize,
-                               PMONITOR->m_size.x + PMONITOR->m_position.x - PMONITOR->m_reservedBottomRight.x - gapsOut.m_right - calcSize.x - borderSize);
-        calcPos.y = std::clamp(calcPos.y, PMONITOR->m_position.y + PMONITOR->m_reservedTopLeft.y + gapsOut.m_top + borderSize,
-                               PMONITOR->m_size.y + PMONITOR->m_position.y - PMONITOR->m_reservedBottomRight.y - gapsOut.m_bottom - calcSize.y - borderSize);
-    }
+    // add to mainStack if not yet satisfied, a rule may only send extra windows to main
+    const bool BMAIN = getMainStackSize(PWORKSPACEID) < mainStackMinimum || (PRULE && PRULE->stack == ORTHOSTATUS_MAIN);
+    auto &STACK = BMAIN ? m_mainStackByWorkspace[PWORKSPACEID] : m_secondaryStackByWorkspace[PWORKSPACEID];
 
-    if (PWINDOW->onSpecialWorkspace() && !PWINDOW->isFullscreen())
+    const auto POSITION = PRULE ? PRULE->position : ORTHOINSERT_TOP;
+    if (POSITION == ORTHOINSERT_BOTTOM)
+        STACK.push_front(node);
+    else if (POSITION == ORTHOINSERT_AFTER_FOCUSED)
     {
-        CBox wb = {calcPos + (calcSize - calcSize) / 2.f, calcSize};
-        wb.round(); // avoid rounding mess
-
-        *PWINDOW->m_realPosition = wb.pos();
-        *PWINDOW->m_realSize = wb.size();
+        // top of the stack is the back, so directly above the focused window
+        const auto PFOCUSED = Desktop::focusState()->window();
+        const auto FOCUSEDIT = std::ranges::find_if(STACK, [&](const auto &nd) { return PFOCUSED && nd.pWindow.lock() == PFOCUSED; });
+        STACK.insert(FOCUSEDIT == STACK.end() ? STACK.end() : std::next(FOCUSEDIT), node);
     }
     else
-    {
-        CBox wb = {calcPos, calcSize};
-        wb.round(); // avoid rounding mess
+        STACK.push_back(node);
 
-        *PWINDOW->m_realPosition = wb.pos();
-        *PWINDOW->m_realSize = wb.size();
-    }
+    markLayoutChanged(PWORKSPACEID);
+    recalculateWorkspaceOrDefer(PWORKSPACEID, pWindow->monitorID());
+    m_pendingWindowUpdates.insert(PWORKSPACEID);
+    debugCheckInvariants(PWORKSPACEID);
+}
 
-    if (m_forceWarps && !*PANIMATE)
+void COrthoLayout::onWindowRemovedTiling(PHLWINDOW pWindow)
+{
+    auto result = getNodeFromWindow(pWindow);
+    if (!result.has_value())
     {
-        g_pHyprRenderer->damageWindow(PWINDOW);
+        return;
+    }
 
-        PWINDOW->m_realPosition->warp();
-        PWINDOW->m_realSize->warp();
+    const auto &[nd, ws, status] = *result;
 
-        g_pHyprRenderer->damageWindow(PWINDOW);
+    auto &MAINSTACK = m_mainStackByWorkspace[ws];
+    auto &SECONDARYSTACK = m_secondaryStackByWorkspace[ws];
+    const auto PORTHOWORKSPACEDATA = getOrthoWorkspaceData(ws);
+    pWindow->m_ruleApplicator->resetProps(Desktop::Rule::RULE_PROP_ALL, Desktop::Types::PRIORITY_LAYOUT);
+    pWindow->updateWindowData();
+
+    if (nd->hiddenByLayout)
+        setNodeHidden(*nd, false);
+
+    auto &STACK = status == ORTHOSTATUS_MAIN ? MAINSTACK : SECONDARYSTACK;
+    const auto IT = std::ranges::find(STACK, *nd);
+
+    SOrthoTombstone tombstone{
+        .pWindow = pWindow,
+        .ws = ws,
+        .status = status,
+        .index = sc<size_t>(std::distance(STACK.begin(), IT)),
+        .weight = nd->weight,
+    };
+
+    STACK.erase(IT);
+
+    // keyed by address, which the next window to be mapped may reuse
+    if (const auto FROZENIT = m_frozenMovedWindows.find(ws); FROZENIT != m_frozenMovedWindows.end())
+        FROZENIT->second.erase(pWindow.get());
+
+    if (pWindow->isFullscreen())
+        g_pCompositor->setWindowFullscreenInternal(pWindow, FSMODE_NONE);
+
+    // a floating toggle is expected to come back, so main is only refilled if it would be left empty
+    const size_t MAINMINIMUM = m_floatToggle ? 1 : PORTHOWORKSPACEDATA->mainStackMin;
+    if (status == ORTHOSTATUS_MAIN && MAINSTACK.size() < MAINMINIMUM && !SECONDARYSTACK.empty())
+    {
+        tombstone.promoted = SECONDARYSTACK.back().pWindow;
+        MAINSTACK.push_back(SECONDARYSTACK.back());
+        SECONDARYSTACK.pop_back();
+    }
+
+    if (m_floatToggle)
+    {
+        std::erase_if(m_tombstones, [&](const auto &t) { return t.pWindow.expired() || t.pWindow.lock() == pWindow; });
+        m_tombstones.push_back(tombstone);
     }
 
-    PWINDOW->updateWindowDecos();
+    markLayoutChanged(ws);
+    // an emptied workspace has nothing left to commit, drop the node from the table anyway
+    m_shmDirty = true;
+    recalculateWorkspaceOrDefer(ws, pWindow->monitorID());
+    m_pendingWindowUpdates.insert(ws);
+    debugCheckInvariants(ws);
 }
 
-bool COrthoLayout::isWindowTiled(PHLWINDOW pWindow)
+void COrthoLayout::changeWindowFloatingMode(PHLWINDOW pWindow)
 {
-    return getNodeFromWindow(pWindow).has_value();
+    m_floatToggle = true;
+    Hyprutils::Utils::CScopeGuard x([this] { m_floatToggle = false; });
+    IHyprLayout::changeWindowFloatingMode(pWindow);
 }
 
-// TODO: maybe, I think this may be doable in a way that makes sense if we use the deltas to affect weights
-void COrthoLayout::resizeActiveWindow(const Vector2D &pixResize, eRectCorner corner, PHLWINDOW pWindow) {}
+void COrthoLayout::onWindowRemovedFloating(PHLWINDOW pWindow)
+{
+    IHyprLayout::onWindowRemovedFloating(pWindow);
 
-void COrthoLayout::fullscreenRequestForWindow(PHLWINDOW pWindow, const eFullscreenMode CURRENT_EFFECTIVE_MODE, const eFullscreenMode EFFECTIVE_MODE)
+    // a floating toggle is about to tile it again and consumes the slot itself
+    if (!m_floatToggle)
+        dropTombstone(pWindow);
+}
+
+void COrthoLayout::dropTombstone(PHLWINDOW pWindow)
 {
-    const auto PMONITOR = pWindow->m_monitor.lock();
-    const auto PWORKSPACE = pWindow->m_workspace;
+    std::erase_if(m_tombstones, [](const auto &t) { return t.pWindow.expired(); });
 
-    // save position and size if floating
-    if (pWindow->m_isFloating && CURRENT_EFFECTIVE_MODE == FSMODE_NONE)
+    const auto IT = std::ranges::find_if(m_tombstones, [&](const auto &t) { return t.pWindow.lock() == pWindow; });
+    if (IT == m_tombstones.end())
+        return;
+
+    const auto WS = IT->ws;
+    const bool BMAIN = IT->status == ORTHOSTATUS_MAIN;
+    m_tombstones.erase(IT);
+
+    // main was only kept at one node while the slot was expected back
+    const auto WSDATA = m_orthoWorkspaceDataByWorkspace.find(WS);
+    const auto MAINIT = m_mainStackByWorkspace.find(WS);
+    const auto SECONDARYIT = m_secondaryStackByWorkspace.find(WS);
+    if (!BMAIN || WSDATA == m_orthoWorkspaceDataByWorkspace.end() || MAINIT == m_mainStackByWorkspace.end() || SECONDARYIT == m_secondaryStackByWorkspace.end())
+        return;
+
+    auto &MAINSTACK = MAINIT->second;
+    auto &SECONDARYSTACK = SECONDARYIT->second;
+    bool promoted = false;
+    while (MAINSTACK.size() < sc<size_t>(WSDATA->second.mainStackMin) && !SECONDARYSTACK.empty())
     {
-        pWindow->m_lastFloatingSize = pWindow->m_realSize->goal();
-        pWindow->m_lastFloatingPosition = pWindow->m_realPosition->goal();
-        pWindow->m_position = pWindow->m_realPosition->goal();
-        pWindow->m_size = pWindow->m_realSize->goal();
+        MAINSTACK.push_back(SECONDARYSTACK.back());
+        SECONDARYSTACK.pop_back();
+        promoted = true;
     }
 
-    if (EFFECTIVE_MODE == FSMODE_NONE)
-    {
-        // if it got its fullscreen disabled, set back its node if it had one
-        const auto result = getNodeFromWindow(pWindow);
-        if (result.has_value())
-        {
-            const auto &[nd, ws, _] = *result;
-            applyNodeDataToWindow(nd, ws);
-        }
-        else
-        {
-            // get back its' dimensions from position and size
-            *pWindow->m_realPosition = pWindow->m_lastFloatingPosition;
-            *pWindow->m_realSize = pWindow->m_lastFloatingSize;
+    if (!promoted)
+        return;
 
-            pWindow->m_ruleApplicator->resetProps(Desktop::Rule::RULE_PROP_ALL, Desktop::Types::PRIORITY_LAYOUT);
-            pWindow->updateWindowData();
-        }
-    }
-    else
+    markLayoutChanged(WS);
+    const auto PWORKSPACE = g_pCompositor->getWorkspaceByID(WS);
+    if (const auto PMONITOR = PWORKSPACE ? PWORKSPACE->m_monitor.lock() : nullptr)
+        recalculateWorkspaceOrDefer(WS, PMONITOR->m_id);
+    m_pendingWindowUpdates.insert(WS);
+    debugCheckInvariants(WS);
+}
+
+bool COrthoLayout::restoreFromTombstone(PHLWINDOW pWindow)
+{
+    const auto IT = std::ranges::find_if(m_tombstones, [&](const auto &t) { return t.pWindow.lock() == pWindow; });
+    if (IT == m_tombstones.end())
+        return false;
+
+    const auto TOMBSTONE = *IT;
+    m_tombstones.erase(IT);
+
+    // the slot is meaningless on any other workspace
+    const auto WS = pWindow->workspaceID();
+    if (TOMBSTONE.ws != WS)
+        return false;
+
+    auto &MAINSTACK = m_mainStackByWorkspace[WS];
+    auto &SECONDARYSTACK = m_secondaryStackByWorkspace[WS];
+
+    // hand the stand-in back before the index is resolved, so main looks like it did before
+    if (TOMBSTONE.status == ORTHOSTATUS_MAIN && !TOMBSTONE.promoted.expired())
     {
-        // apply new pos and size being monitors' box
-        if (EFFECTIVE_MODE == FSMODE_FULLSCREEN)
+        const auto PROMOTEDIT = std::ranges::find_if(MAINSTACK, [&](const auto &nd) { return nd.pWindow == TOMBSTONE.promoted; });
+        if (PROMOTEDIT != MAINSTACK.end())
         {
-            *pWindow->m_realPosition = PMONITOR->m_position;
-            *pWindow->m_realSize = PMONITOR->m_size;
+            SECONDARYSTACK.push_back(*PROMOTEDIT);
+            MAINSTACK.erase(PROMOTEDIT);
         }
-        else
-        {
-            // This is a massive hack.
-            // We make a fake "only" node and apply
-            // To keep consistent with the settings without C+P code
+    }
 
-            SOrthoNodeData fakeNode;
-            fakeNode.pWindow = pWindow;
-            fakeNode.position = PMONITOR->m_position + PMONITOR->m_reservedTopLeft;
-            fakeNode.size = PMONITOR->m_size - PMONITOR->m_reservedTopLeft - PMONITOR->m_reservedBottomRight;
-            pWindow->m_position = fakeNode.position;
-            pWindow->m_size = fakeNode.size;
-            fakeNode.ignoreFullscreenChecks = true;
+    auto &STACK = TOMBSTONE.status == ORTHOSTATUS_MAIN ? MAINSTACK : SECONDARYSTACK;
+    STACK.insert(STACK.begin() + std::min(TOMBSTONE.index, STACK.size()), SOrthoNodeData{.pWindow = pWindow, .weight = TOMBSTONE.weight});
 
-            applyNodeDataToWindow(&fakeNode, pWindow->workspaceID());
-        }
+    markLayoutChanged(WS);
+    recalculateWorkspaceOrDefer(WS, pWindow->monitorID());
+    m_pendingWindowUpdates.insert(WS);
+    debugCheckInvariants(WS);
+    return true;
+}
+
+void COrthoLayout::recalculateWorkspaceOrDefer(const WORKSPACEID &ws, const MONITORID &monid)
+{
+    const auto PWORKSPACE = g_pCompositor->getWorkspaceByID(ws);
+
+    // nobody can see the workspace, position its windows once it becomes visible
+    if (!PWORKSPACE || !PWORKSPACE->isVisible())
+    {
+        m_dirtyWorkspaces.insert(ws);
+        return;
     }
 
-    g_pCompositor->changeWindowZOrder(pWindow, true);
+    relayoutMonitor(monid);
 }
 
-void COrthoLayout::recalculateWindow(PHLWINDOW pWindow)
+void COrthoLayout::recalculateMonitor(const MONITORID &monid)
 {
-    const auto result = getNodeFromWindow(pWindow);
-    if (!result.has_value())
+    // the compositor asks for this on every monitor change while they are still coming and going,
+    // everything is remapped in one pass once they settle
+    if (m_topologySettling)
         return;
-    recalculateMonitor(pWindow->monitorID());
+
+    relayoutMonitor(monid);
 }
 
-SWindowRenderLayoutHints COrthoLayout::requestRenderHints(PHLWINDOW pWindow)
+void COrthoLayout::relayoutMonitor(const MONITORID &monid)
 {
-    SWindowRenderLayoutHints hints;
-    return hints;
+    const auto PMONITOR = g_pCompositor->getMonitorFromID(monid);
+
+    if (!PMONITOR || !PMONITOR->m_activeWorkspace)
+        return;
+
+    g_pHyprRenderer->damageMonitor(PMONITOR);
+
+    if (PMONITOR->m_activeSpecialWorkspace)
+        calculateWorkspace(PMONITOR->m_activeSpecialWorkspace);
+
+    calculateWorkspace(PMONITOR->m_activeWorkspace);
+
+    // the work area is shared by all monitors, send it once per burst
+    m_x11WorkAreaDirty = true;
+    schedulePostPassFlush();
 }
 
-void COrthoLayout::moveWindowTo(PHLWINDOW pWindow, const std::string &dir, bool silent)
+void COrthoLayout::updateX11WorkArea()
 {
-    if (!isDirection(dir))
+#ifndef NO_XWAYLAND
+    if (!g_pXWayland || !g_pXWayland->m_wm)
+        return;
+    CBox box = g_pCompositor->calculateX11WorkArea();
+    // every update is a round trip to the X server, skip it while the reserved areas stay put
+    if (m_lastX11WorkArea.has_value() && *m_lastX11WorkArea == box)
         return;
+    m_lastX11WorkArea = box;
+    g_pXWayland->m_wm->updateWorkArea(box.x, box.y, box.w, box.h);
+#endif
+}
 
-    const auto PWINDOW2 = g_pCompositor->getWindowInDirection(pWindow, dir[0]);
+void COrthoLayout::onTopologyChanged()
+{
+    static auto PSETTLEMS = CConfigValue<Hyprlang::INT>("plugin:ortho:hotplug_settle_ms");
+    if (*PSETTLEMS <= 0)
+        return;
 
-    if (!PWINDOW2)
+    m_topologySettling = true;
+
+    if (!m_topologyTimer)
+    {
+        m_topologyTimer = makeShared<CEventLoopTimer>(std::nullopt, [this](SP<CEventLoopTimer> self, void *data) { onTopologySettled(); }, nullptr);
+        g_pEventLoopManager->addTimer(m_topologyTimer);
+    }
+
+    // every further change pushes the deadline back
+    m_topologyTimer->updateTimeout(std::chrono::milliseconds(*PSETTLEMS));
+}
+
+void COrthoLayout::onTopologySettled()
+{
+    static auto PSNAP = CConfigValue<Hyprlang::INT>("plugin:ortho:hotplug_snap");
+
+    m_topologySettling = false;
+
+    // geometry is proportional to weights and percMainStack, so one pass carries the proportions
+    // over to the new monitor sizes. hidden workspaces follow when they are shown.
+    for (const auto &[ws, _] : m_orthoWorkspaceDataByWorkspace)
+    {
+        m_dirtyWorkspaces.insert(ws);
+    }
+
+    m_warpAll = *PSNAP;
+    Hyprutils::Utils::CScopeGuard x([this] { m_warpAll = false; });
+
+    for (auto const &m : g_pCompositor->m_monitors)
+    {
+        relayoutMonitor(m->m_id);
+    }
+}
+
+void COrthoLayout::calculateWorkspace(PHLWORKSPACE pWorkspace)
+{
+    const auto PMONITOR = pWorkspace->m_monitor.lock();
+    const auto WS = pWorkspace->m_id;
+    if (!PMONITOR)
         return;
 
-    pWindow->setAnimationsToMove();
+    const auto WORKSPACEDATA = getOrthoWorkspaceData(WS);
+    markLayoutChanged(WS);
+    m_dirtyWorkspaces.erase(WS);
+
+    // the workspace moved to another monitor, pick up that monitor's settings
+    if (WORKSPACEDATA->monitorID != PMONITOR->m_id)
+        WORKSPACEDATA->applySettings(resolveSettings(WS, PMONITOR));
+
+    invalidateNodePropsOnSelectorChange(pWorkspace);
+
+    const bool FROZEN = pWorkspace->m_hasFullscreenWindow;
+    if (FROZEN)
+    {
+        // massive hack from the fullscreen func
+        const auto PFULLWINDOW = pWorkspace->getFullscreenWindow();
+
+        if (pWorkspace->m_fullscreenMode == FSMODE_FULLSCREEN)
+        {
+            *PFULLWINDOW->m_realPosition = PMONITOR->m_position;
+            *PFULLWINDOW->m_realSize = PMONITOR->m_size;
+        }
+        else if (pWorkspace->m_fullscreenMode == FSMODE_MAXIMIZED)
+        {
+            SOrthoNodeData fakeNode;
+            fakeNode.pWindow = PFULLWINDOW;
+            fakeNode.position = PMONITOR->m_position + PMONITOR->m_reservedTopLeft;
+            fakeNode.size = PMONITOR->m_size - PMONITOR->m_reservedTopLeft - PMONITOR->m_reservedBottomRight;
+            PFULLWINDOW->m_position = fakeNode.position;
+            PFULLWINDOW->m_size = fakeNode.size;
+            fakeNode.ignoreFullscreenChecks = true;
+
+            applyNodeDataToWindow(&fakeNode, pWorkspace->m_id);
+        }
+    }
+
+    auto &MAINSTACK = m_mainStackByWorkspace[WS];
+    auto &SECONDARYSTACK = m_secondaryStackByWorkspace[WS];
+
+    if (MAINSTACK.empty())
+        return;
+
+    std::vector<std::pair<Vector2D, Vector2D>> previousBoxes;
+    previousBoxes.reserve(MAINSTACK.size() + SECONDARYSTACK.size());
+    for (const auto &nd : MAINSTACK)
+        previousBoxes.emplace_back(nd.position, nd.size);
+    for (const auto &nd : SECONDARYSTACK)
+        previousBoxes.emplace_back(nd.position, nd.size);
+
+    // workspace hopping recalculates with unchanged inputs, the boxes only depend on the key
+    auto &CACHE = m_geometryCacheByWorkspace[WS];
+    auto key = getGeometryKey(pWorkspace, PMONITOR, WORKSPACEDATA);
+    const bool CACHEHIT = CACHE.key.has_value() && *CACHE.key == key;
+    if (CACHEHIT)
+    {
+        ++CACHE.hits;
+        size_t boxIdx = 0;
+        for (auto *stack : {&MAINSTACK, &SECONDARYSTACK})
+        {
+            for (auto &nd : *stack)
+            {
+                const auto &BOX = CACHE.boxes[boxIdx++];
+                nd.position = BOX.position;
+                nd.size = BOX.size;
+                nd.column = BOX.column;
+                nd.row = BOX.row;
+                nd.collapsed = BOX.collapsed;
+            }
+        }
+    }
+    else
+    {
+        ++CACHE.misses;
+        computeWorkspaceGeometry(PMONITOR, WORKSPACEDATA, MAINSTACK, SECONDARYSTACK);
+
+        CACHE.key = std::move(key);
+        CACHE.committed = false;
+        CACHE.boxes.clear();
+        CACHE.boxes.reserve(MAINSTACK.size() + SECONDARYSTACK.size());
+        for (const auto *stack : {&MAINSTACK, &SECONDARYSTACK})
+        {
+            for (const auto &nd : *stack)
+            {
+                CACHE.boxes.push_back({.position = nd.position, .size = nd.size, .column = nd.column, .row = nd.row, .collapsed = nd.collapsed});
+            }
+        }
+    }
+
+    int movedNodes = 0;
+    size_t idx = 0;
+    for (const auto *stack : {&MAINSTACK, &SECONDARYSTACK})
+    {
+        for (const auto &nd : *stack)
+        {
+            if (previousBoxes[idx++] == std::pair{nd.position, nd.size})
+                continue;
+            ++movedNodes;
+            if (FROZEN)
+                m_frozenMovedWindows[WS].insert(nd.pWindow.lock().get());
+        }
+    }
+
+    // everything else is covered by the fullscreen window, its clients get configured once on exit
+    if (FROZEN)
+    {
+        if (const auto PENDING = m_pendingCommitsByWorkspace.find(WS); PENDING != m_pendingCommitsByWorkspace.end())
+        {
+            for (size_t i = PENDING->second.next; i < PENDING->second.commits.size(); ++i)
+            {
+                m_frozenMovedWindows[WS].insert(PENDING->second.commits[i].pWindow.lock().get());
+            }
+            m_pendingCommitsByWorkspace.erase(PENDING);
+        }
+        CACHE.committed = false;
+        // nothing gets committed, but stack order and weights may have changed under the frozen boxes
+        m_shmDirty = true;
+        return;
+    }
+    m_frozenMovedWindows.erase(WS);
+
+    // same boxes as the last finished commit and nobody moved the windows since
+    if (CACHEHIT && CACHE.committed && !m_warpAll && isCommitCurrent(WS, CACHE))
+    {
+        ++CACHE.skippedCommits;
+        m_shmDirty = true;
+        return;
+    }
+
+    // the fullscreen exit already committed this burst's changes
+    if (m_fullscreenExitCommitted.contains(WS) && movedNodes == 0 &&
+        std::ranges::all_of(MAINSTACK, [](const auto &nd) { return nd.propsApplied; }) &&
+        std::ranges::all_of(SECONDARYSTACK, [](const auto &nd) { return nd.collapsed || nd.propsApplied; }))
+        return;
+
+    const auto WARPSTATUS = getWarpPolicy(WS, movedNodes);
+    const auto PFOCUSED = Desktop::focusState()->window();
+
+    std::vector<SOrthoPendingCommit> commits;
+    commits.reserve(MAINSTACK.size() + SECONDARYSTACK.size());
+
+    for (auto &nd : MAINSTACK)
+    {
+        if (nd.hiddenByLayout)
+            setNodeHidden(nd, false);
+        commits.push_back({.pWindow = nd.pWindow, .warp = WARPSTATUS.warpMain});
+    }
+
+    for (auto &nd : SECONDARYSTACK)
+    {
+        if (nd.hiddenByLayout != nd.collapsed)
+            setNodeHidden(nd, nd.collapsed);
+        // parked windows get neither a box nor a configure
+        if (!nd.collapsed)
+            commits.push_back({.pWindow = nd.pWindow, .warp = WARPSTATUS.warpSecondary});
+    }
+
+    // in case the commit gets sliced, windows already on screen go before those still arriving from
+    // elsewhere, and the focused window goes first of all
+    const CBox MONITORBOX = {PMONITOR->m_position, PMONITOR->m_size};
+    std::ranges::stable_partition(commits,
+                                  [&](const auto &commit)
+                                  {
+                                      const auto PWINDOW = commit.pWindow.lock();
+                                      return PWINDOW && CBox{PWINDOW->m_realPosition->value(), PWINDOW->m_realSize->value()}.overlaps(MONITORBOX);
+                                  });
+    const auto FOCUSEDIT = std::ranges::find_if(commits, [&](const auto &commit) { return PFOCUSED && commit.pWindow.lock() == PFOCUSED; });
+    if (FOCUSEDIT != commits.end())
+        std::rotate(commits.begin(), FOCUSEDIT, FOCUSEDIT + 1);
+
+    commitWorkspace(WS, PMONITOR, std::move(commits));
+}
+
+void COrthoLayout::commitFrozenWorkspace(const WORKSPACEID &ws, PHLWINDOW pFullscreenWindow)
+{
+    const auto PWORKSPACE = g_pCompositor->getWorkspaceByID(ws);
+    const auto PMONITOR = PWORKSPACE ? PWORKSPACE->m_monitor.lock() : nullptr;
+    if (!PMONITOR)
+        return;
+
+    auto moved = std::move(m_frozenMovedWindows[ws]);
+    m_frozenMovedWindows.erase(ws);
+    moved.insert(pFullscreenWindow.get());
+
+    invalidateNodePropsOnSelectorChange(PWORKSPACE);
+
+    // only the window leaving fullscreen, the nodes that moved behind it and those whose window data is stale
+    std::vector<SOrthoPendingCommit> commits;
+    commits.push_back({.pWindow = pFullscreenWindow});
+    auto &MAINSTACK = m_mainStackByWorkspace[ws];
+    for (auto *stack : {&MAINSTACK, &m_secondaryStackByWorkspace[ws]})
+    {
+        for (auto &nd : *stack)
+        {
+            const bool HIDE = stack != &MAINSTACK && nd.collapsed;
+            if (nd.hiddenByLayout != HIDE)
+                setNodeHidden(nd, HIDE);
+
+            const auto PWINDOW = nd.pWindow.lock();
+            if (!HIDE && PWINDOW != pFullscreenWindow && (moved.contains(PWINDOW.get()) || !nd.propsApplied))
+                commits.push_back({.pWindow = nd.pWindow});
+        }
+    }
+
+    m_fullscreenExitCommitted.insert(ws);
+    m_x11WorkAreaDirty = true;
+    schedulePostPassFlush();
+    commitWorkspace(ws, PMONITOR, std::move(commits));
+}
+
+SOrthoGeometryKey COrthoLayout::getGeometryKey(PHLWORKSPACE pWorkspace, PHLMONITOR pMonitor, SOrthoWorkspaceData *pWorkspaceData)
+{
+    static auto PGAPSINDATA = CConfigValue<Hyprlang::CUSTOMTYPE>("general:gaps_in");
+    static auto PGAPSOUTDATA = CConfigValue<Hyprlang::CUSTOMTYPE>("general:gaps_out");
+    static auto PMINROWHEIGHT = CConfigValue<Hyprlang::INT>("plugin:ortho:secondary_min_row_height");
+    static auto PSECONDARYVISIBLE = CConfigValue<Hyprlang::INT>("plugin:ortho:secondary_visible");
+
+    const auto WORKSPACERULE = g_pConfigManager->getWorkspaceRuleFor(pWorkspace);
+    const auto GAPSIN = WORKSPACERULE.gapsIn.value_or(*sc<CCssGapData *>((PGAPSINDATA.ptr())->getData()));
+    const auto GAPSOUT = WORKSPACERULE.gapsOut.value_or(*sc<CCssGapData *>((PGAPSOUTDATA.ptr())->getData()));
+
+    SOrthoGeometryKey key{
+        .monitorPosition = pMonitor->m_position,
+        .monitorSize = pMonitor->m_size,
+        .reservedTopLeft = pMonitor->m_reservedTopLeft,
+        .reservedBottomRight = pMonitor->m_reservedBottomRight,
+        .scale = pMonitor->m_scale,
+        .gaps = {GAPSIN.m_top, GAPSIN.m_right, GAPSIN.m_bottom, GAPSIN.m_left, GAPSOUT.m_top, GAPSOUT.m_right, GAPSOUT.m_bottom, GAPSOUT.m_left},
+        .percMainStack = pWorkspaceData->percMainStack,
+        .mainSide = pWorkspaceData->mainSide,
+        .overrideMainWeights = pWorkspaceData->overrideMainWeights,
+        .mainWeightOverrides = pWorkspaceData->mainWeightOverrides,
+        .secondaryVisible = *PSECONDARYVISIBLE,
+        .minRowHeight = *PMINROWHEIGHT,
+    };
+
+    for (const auto &nd : m_mainStackByWorkspace[pWorkspace->m_id])
+    {
+        key.mainWeights.push_back(nd.weight);
+    }
+    for (const auto &nd : m_secondaryStackByWorkspace[pWorkspace->m_id])
+    {
+        key.secondaryWeights.push_back(nd.weight);
+    }
+
+    return key;
+}
+
+void COrthoLayout::invalidateGeometryCache(const WORKSPACEID &ws)
+{
+    const auto IT = m_geometryCacheByWorkspace.find(ws);
+    if (IT == m_geometryCacheByWorkspace.end())
+        return;
+
+    IT->second.key.reset();
+    IT->second.committed = false;
+}
+
+void COrthoLayout::onCommitFinished(const WORKSPACEID &ws)
+{
+    m_shmDirty = true;
+    schedulePostPassFlush();
+
+    const auto IT = m_geometryCacheByWorkspace.find(ws);
+    if (IT == m_geometryCacheByWorkspace.end() || !IT->second.key.has_value())
+        return;
+
+    auto &cache = IT->second;
+    cache.committedGoals.clear();
+    for (const auto *stack : {&m_mainStackByWorkspace[ws], &m_secondaryStackByWorkspace[ws]})
+    {
+        for (const auto &nd : *stack)
+        {
+            const auto PWINDOW = nd.pWindow.lock();
+            if (!PWINDOW || nd.collapsed)
+                continue;
+            cache.committedGoals.emplace_back(PWINDOW, CBox{PWINDOW->m_realPosition->goal(), PWINDOW->m_realSize->goal()});
+        }
+    }
+    cache.committed = true;
+}
+
+bool COrthoLayout::isCommitCurrent(const WORKSPACEID &ws, const SOrthoGeometryCache &cache)
+{
+    size_t idx = 0;
+    for (const auto *stack : {&m_mainStackByWorkspace[ws], &m_secondaryStackByWorkspace[ws]})
+    {
+        for (const auto &nd : *stack)
+        {
+            if (nd.hiddenByLayout != nd.collapsed)
+                return false;
+            if (nd.collapsed)
+                continue;
+
+            const auto PWINDOW = nd.pWindow.lock();
+            if (!PWINDOW || !nd.propsApplied || idx >= cache.committedGoals.size())
+                return false;
+
+            const auto &[window, goal] = cache.committedGoals[idx++];
+            if (window.lock() != PWINDOW || PWINDOW->m_realPosition->goal() != goal.pos() || PWINDOW->m_realSize->goal() != goal.size())
+                return false;
+        }
+    }
+
+    return idx == cache.committedGoals.size();
+}
+
+void COrthoLayout::commitWorkspace(const WORKSPACEID &ws, PHLMONITOR pMonitor, std::vector<SOrthoPendingCommit> &&commits)
+{
+    static auto PCOMMITBUDGET = CConfigValue<Hyprlang::FLOAT>("plugin:ortho:commit_budget");
+    static auto PCOMMITMAXFRAMES = CConfigValue<Hyprlang::INT>("plugin:ortho:commit_max_frames");
+
+    // a newer pass supersedes whatever is left of an older one
+    m_pendingCommitsByWorkspace.erase(ws);
+
+    SOrthoPendingWorkspaceCommit pending{
+        .commits = std::move(commits),
+    };
+
+    if (*PCOMMITBUDGET > 0 && pMonitor->m_refreshRate > 0)
+    {
+        pending.frameInterval = std::chrono::duration<float, std::milli>(1000.F / pMonitor->m_refreshRate);
+        pending.budget = pending.frameInterval * *PCOMMITBUDGET;
+        // every slice applies at least this much, so the whole pass converges within commit_max_frames
+        const size_t MAXFRAMES = std::max<Hyprlang::INT>(*PCOMMITMAXFRAMES, 1);
+        pending.minPerSlice = (pending.commits.size() + MAXFRAMES - 1) / MAXFRAMES;
+    }
+    else
+        pending.minPerSlice = pending.commits.size();
+
+    if (!commitSlice(ws, pending))
+    {
+        onCommitFinished(ws);
+        return;
+    }
+
+    m_pendingCommitsByWorkspace[ws] = std::move(pending);
+    scheduleCommitContinuation();
+}
+
+bool COrthoLayout::commitSlice(const WORKSPACEID &ws, SOrthoPendingWorkspaceCommit &pending)
+{
+    const auto START = std::chrono::steady_clock::now();
+
+    // nodes may have moved since the pass was queued, look them up by window
+    std::unordered_map<CWindow *, SOrthoNodeData *> nodesByWindow;
+    for (auto *stacks : {&m_mainStackByWorkspace, &m_secondaryStackByWorkspace})
+    {
+        if (const auto IT = stacks->find(ws); IT != stacks->end())
+        {
+            for (auto &nd : IT->second)
+            {
+                nodesByWindow[nd.pWindow.lock().get()] = &nd;
+            }
+        }
+    }
+
+    size_t applied = 0;
+    while (pending.next < pending.commits.size())
+    {
+        if (applied >= pending.minPerSlice && std::chrono::steady_clock::now() - START >= pending.budget)
+            break;
+
+        const auto &COMMIT = pending.commits[pending.next++];
+        ++applied;
+
+        const auto PWINDOW = COMMIT.pWindow.lock();
+        if (!PWINDOW)
+            continue;
+
+        if (const auto NODE = nodesByWindow.find(PWINDOW.get()); NODE != nodesByWindow.end())
+            applyNodeDataToWindow(NODE->second, ws, COMMIT.warp);
+    }
+
+    return pending.next < pending.commits.size();
+}
+
+void COrthoLayout::scheduleCommitContinuation()
+{
+    if (m_commitContinuationScheduled || m_pendingCommitsByWorkspace.empty())
+        return;
+
+    // idle callbacks queued from an idle callback run in the same dispatch, a timer returns to
+    // epoll first so the frames of the slices already applied get rendered
+    if (!m_commitTimer)
+    {
+        m_commitTimer = makeShared<CEventLoopTimer>(std::nullopt, [this](SP<CEventLoopTimer> self, void *data) { continueCommits(); }, nullptr);
+        g_pEventLoopManager->addTimer(m_commitTimer);
+    }
+
+    auto interval = std::chrono::duration<float, std::milli>::max();
+    for (const auto &[ws, pending] : m_pendingCommitsByWorkspace)
+    {
+        interval = std::min(interval, pending.frameInterval);
+    }
+
+    m_commitContinuationScheduled = true;
+    m_commitTimer->updateTimeout(std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval));
+}
+
+void COrthoLayout::continueCommits()
+{
+    m_commitContinuationScheduled = false;
+
+    for (auto it = m_pendingCommitsByWorkspace.begin(); it != m_pendingCommitsByWorkspace.end();)
+    {
+        if (commitSlice(it->first, it->second))
+            ++it;
+        else
+        {
+            onCommitFinished(it->first);
+            it = m_pendingCommitsByWorkspace.erase(it);
+        }
+    }
+
+    scheduleCommitContinuation();
+}
+
+void COrthoLayout::setNodeHidden(SOrthoNodeData &nd, bool hidden)
+{
+    nd.hiddenByLayout = hidden;
+
+    const auto PWINDOW = nd.pWindow.lock();
+    if (!PWINDOW)
+        return;
+
+    if (hidden)
+        g_pHyprRenderer->damageWindow(PWINDOW);
+
+    PWINDOW->setHidden(hidden);
+
+    if (!hidden)
+        g_pHyprRenderer->damageWindow(PWINDOW);
+}
+
+void COrthoLayout::invalidateNodePropsOnSelectorChange(PHLWORKSPACE pWorkspace)
+{
+    const auto WORKSPACEDATA = getOrthoWorkspaceData(pWorkspace->m_id);
+    const int TILED = getNodeCountOnWorkspace(pWorkspace->m_id);
+    const bool FULLSCREEN = pWorkspace->m_hasFullscreenWindow;
+    if (WORKSPACEDATA->propsTiledCount == TILED && WORKSPACEDATA->propsFullscreen == FULLSCREEN)
+        return;
+
+    WORKSPACEDATA->propsTiledCount = TILED;
+    WORKSPACEDATA->propsFullscreen = FULLSCREEN;
+    for (auto *stacks : {&m_mainStackByWorkspace, &m_secondaryStackByWorkspace})
+    {
+        if (const auto IT = stacks->find(pWorkspace->m_id); IT != stacks->end())
+        {
+            for (auto &nd : IT->second)
+            {
+                nd.propsApplied = false;
+            }
+        }
+    }
+}
+
+void COrthoLayout::bringNodeForward(PHLWINDOW pWindow)
+{
+    const auto RESULT = getNodeFromWindow(pWindow);
+    if (!RESULT.has_value() || !RESULT->nd->collapsed)
+        return;
+
+    // a parked window got focus some other way, put it on top so it becomes visible
+    auto &SECONDARYSTACK = m_secondaryStackByWorkspace[RESULT->ws];
+    const auto NODEIT = std::ranges::find(SECONDARYSTACK, *RESULT->nd);
+    if (NODEIT == SECONDARYSTACK.end())
+        return;
+
+    auto node = *NODEIT;
+    SECONDARYSTACK.erase(NODEIT);
+    SECONDARYSTACK.push_back(node);
+    relayoutMonitor(pWindow->monitorID());
+}
+
+SOrthoWarpDecision COrthoLayout::getWarpPolicy(const WORKSPACEID &ws, int movedNodes)
+{
+    static auto PWARPTHRESHOLD = CConfigValue<Hyprlang::INT>("plugin:ortho:warp_threshold");
+    static auto PFRAMEBUDGET = CConfigValue<Hyprlang::FLOAT>("plugin:ortho:frame_budget_ms");
+    static auto PWARPPOLICY = CConfigValue<std::string>("plugin:ortho:warp_policy");
+
+    if (m_warpAll)
+        return {.warpMain = true, .warpSecondary = true};
+
+    const bool BTOOMANY = *PWARPTHRESHOLD > 0 && movedNodes > *PWARPTHRESHOLD;
+    const bool BTOOSLOW = *PFRAMEBUDGET > 0 && m_lastFrameTimeMs > *PFRAMEBUDGET;
+
+    if (!BTOOMANY && !BTOOSLOW)
+        return {};
+
+    if (*PWARPPOLICY != "focused_stack")
+        return {.warpMain = true, .warpSecondary = true};
+
+    // keep animating the stack the user is looking at, warp everything else
+    const auto PFOCUSED = Desktop::focusState()->window();
+    const auto RESULT = PFOCUSED ? getNodeFromWindow(PFOCUSED) : std::nullopt;
+    if (!RESULT.has_value() || RESULT->ws != ws)
+        return {.warpMain = true, .warpSecondary = true};
+
+    return {.warpMain = RESULT->status != ORTHOSTATUS_MAIN, .warpSecondary = RESULT->status != ORTHOSTATUS_SECONDARY};
+}
+
+// splits an integer extent into shares proportional to weights using the largest remainder method.
+// every pixel is handed out exactly once and ties go to the lower index, so a node's share only
+// moves when its own proportion does.
+static std::vector<int> partitionExtent(int extent, const std::vector<double> &weights)
+{
+    std::vector<int> shares(weights.size(), 0);
+    if (weights.empty() || extent <= 0)
+        return shares;
+
+    double totalWeight = 0.0;
+    for (const auto w : weights)
+    {
+        totalWeight += std::max(w, 0.0);
+    }
+
+    std::vector<double> remainders(weights.size(), 0.0);
+    int assigned = 0;
+    for (size_t i = 0; i < weights.size(); ++i)
+    {
+        // degenerate weights fall back to an even split
+        const double EXACT = totalWeight > 0.0 ? extent * std::max(weights[i], 0.0) / totalWeight : sc<double>(extent) / weights.size();
+        shares[i] = sc<int>(std::floor(EXACT));
+        remainders[i] = EXACT - shares[i];
+        assigned += shares[i];
+    }
+
+    std::vector<size_t> order(weights.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::stable_sort(order, [&](size_t a, size_t b) { return remainders[a] > remainders[b]; });
+
+    for (size_t i = 0; assigned < extent; i = (i + 1) % order.size(), ++assigned)
+    {
+        ++shares[order[i]];
+    }
+
+    return shares;
+}
+
+void COrthoLayout::computeWorkspaceGeometry(PHLMONITOR pMonitor, SOrthoWorkspaceData *pWorkspaceData, std::deque<SOrthoNodeData> &mainStack,
+                                            std::deque<SOrthoNodeData> &secondaryStack)
+{
+    const bool BISRIGHT = pWorkspaceData->mainSide == MAIN_SIDE_RIGHT;
+    const bool BOVERRIDEMAIN = pWorkspaceData->overrideMainWeights;
+    const auto &OVERRIDEWEIGHTS = pWorkspaceData->mainWeightOverrides;
+
+    // all partitioning happens in integer physical pixels relative to the monitor origin,
+    // boxes are only converted back to logical coordinates at the very end
+    const double SCALE = pMonitor->m_scale;
+    const auto TOPLEFT = Vector2D(std::round(pMonitor->m_reservedTopLeft.x * SCALE), std::round(pMonitor->m_reservedTopLeft.y * SCALE));
+    const auto BOTTOMRIGHT = Vector2D(std::round((pMonitor->m_size.x - pMonitor->m_reservedBottomRight.x) * SCALE),
+                                      std::round((pMonitor->m_size.y - pMonitor->m_reservedBottomRight.y) * SCALE));
+    const int EXTENTX = std::max(sc<int>(BOTTOMRIGHT.x - TOPLEFT.x), 0);
+    const int EXTENTY = std::max(sc<int>(BOTTOMRIGHT.y - TOPLEFT.y), 0);
+
+    const auto toLogical = [&](int x, int y, int w, int h, SOrthoNodeData &nd)
+    {
+        nd.position = pMonitor->m_position + (TOPLEFT + Vector2D(x, y)) / SCALE;
+        nd.size = Vector2D(w, h) / SCALE;
+    };
+
+    // calculate the main stack
+    const int widthToSplit = secondaryStack.empty() ? EXTENTX : sc<int>(std::round(EXTENTX * pWorkspaceData->percMainStack));
+
+    std::vector<double> weights;
+    weights.reserve(mainStack.size());
+    for (size_t i = 0; i < mainStack.size(); ++i)
+    {
+        if (!BOVERRIDEMAIN)
+            weights.push_back(mainStack[i].weight);
+        else
+            weights.push_back(i < OVERRIDEWEIGHTS.size() ? OVERRIDEWEIGHTS[i] : 1.0);
+    }
+
+    const auto MAINWIDTHS = partitionExtent(widthToSplit, weights);
+
+    // bottom of main stack is right next to the secondary stack
+    // iteration is happening in reverse stack order
+    // start drawing from the inside
+    int nextX = BISRIGHT ? EXTENTX - widthToSplit : widthToSplit;
+
+    for (size_t i = 0; i < mainStack.size(); ++i)
+    {
+        const int WIDTH = MAINWIDTHS[i];
+
+        if (!BISRIGHT)
+            nextX -= WIDTH;
+
+        toLogical(nextX, 0, WIDTH, EXTENTY, mainStack[i]);
+        mainStack[i].collapsed = false;
+
+        if (BISRIGHT)
+            nextX += WIDTH;
+    }
+
+    if (secondaryStack.empty())
+        return;
+
+    static auto PMINROWHEIGHT = CConfigValue<Hyprlang::INT>("plugin:ortho:secondary_min_row_height");
+    static auto PSECONDARYVISIBLE = CConfigValue<Hyprlang::INT>("plugin:ortho:secondary_visible");
+
+    // a collapsed stack only lays out its top nodes, the rest is parked until cycled forward
+    const size_t FIRSTVISIBLE = *PSECONDARYVISIBLE > 0 && sc<Hyprlang::INT>(secondaryStack.size()) > *PSECONDARYVISIBLE ? secondaryStack.size() - *PSECONDARYVISIBLE : 0;
+    const size_t VISIBLENODES = secondaryStack.size() - FIRSTVISIBLE;
+    for (size_t i = 0; i < secondaryStack.size(); ++i)
+    {
+        secondaryStack[i].collapsed = i < FIRSTVISIBLE;
+    }
+
+    // wrap into as many columns as needed to keep every row at least the minimum height,
+    // columns take contiguous runs of the stack and split the area evenly
+    const int MINROWPX = sc<int>(std::round(std::max<Hyprlang::INT>(*PMINROWHEIGHT, 0) * SCALE));
+    const size_t ROWSPERCOLUMN = MINROWPX > 0 ? std::max(EXTENTY / MINROWPX, 1) : VISIBLENODES;
+    const size_t COLUMNS = (VISIBLENODES + ROWSPERCOLUMN - 1) / ROWSPERCOLUMN;
+    const auto COLUMNWIDTHS = partitionExtent(EXTENTX - widthToSplit, std::vector<double>(COLUMNS, 1.0));
+
+    // secondary stack is top of stack on top of screen
+    // start drawing from the bottom, the first column sits next to the main stack
+    nextX = BISRIGHT ? EXTENTX - widthToSplit : widthToSplit;
+    size_t nodeIdx = FIRSTVISIBLE;
+    for (size_t column = 0; column < COLUMNS; ++column)
+    {
+        const size_t NODESINCOLUMN = VISIBLENODES / COLUMNS + (column < VISIBLENODES % COLUMNS ? 1 : 0);
+        const int WIDTH = COLUMNWIDTHS[column];
+
+        weights.clear();
+        for (size_t i = nodeIdx; i < nodeIdx + NODESINCOLUMN; ++i)
+        {
+            weights.push_back(secondaryStack[i].weight);
+        }
+
+        const auto HEIGHTS = partitionExtent(EXTENTY, weights);
+
+        if (BISRIGHT)
+            nextX -= WIDTH;
+
+        int nextY = EXTENTY;
+        for (size_t row = 0; row < NODESINCOLUMN; ++row, ++nodeIdx)
+        {
+            auto &nd = secondaryStack[nodeIdx];
+            nextY -= HEIGHTS[row];
+            toLogical(nextX, nextY, WIDTH, HEIGHTS[row], nd);
+            nd.column = column;
+            nd.row = row;
+        }
+
+        if (!BISRIGHT)
+            nextX += WIDTH;
+    }
+}
+
+// rounds the edges of a logical box onto the monitor's physical pixel grid. rounding edges instead of
+// position and size keeps neighbours that share an edge sharing it, so no seams or overlaps appear.
+static CBox snapBoxToPixelGrid(const CBox &box, PHLMONITOR pMonitor)
+{
+    const double SCALE = pMonitor->m_scale;
+    const auto ORIGIN = pMonitor->m_position;
+
+    const double X1 = std::round((box.x - ORIGIN.x) * SCALE);
+    const double Y1 = std::round((box.y - ORIGIN.y) * SCALE);
+    const double X2 = std::round((box.x + box.w - ORIGIN.x) * SCALE);
+    const double Y2 = std::round((box.y + box.h - ORIGIN.y) * SCALE);
+
+    return CBox{ORIGIN.x + X1 / SCALE, ORIGIN.y + Y1 / SCALE, (X2 - X1) / SCALE, (Y2 - Y1) / SCALE};
+}
+
+CBox COrthoLayout::getWindowBoxForNode(const SOrthoNodeData &node, PHLMONITOR PMONITOR, PHLWINDOW PWINDOW)
+{
+    // for gaps outer
+    const bool DISPLAYLEFT = STICKS(node.position.x, PMONITOR->m_position.x + PMONITOR->m_reservedTopLeft.x);
+    const bool DISPLAYRIGHT = STICKS(node.position.x + node.size.x, PMONITOR->m_position.x + PMONITOR->m_size.x - PMONITOR->m_reservedBottomRight.x);
+    const bool DISPLAYTOP = STICKS(node.position.y, PMONITOR->m_position.y + PMONITOR->m_reservedTopLeft.y);
+    const bool DISPLAYBOTTOM = STICKS(node.position.y + node.size.y, PMONITOR->m_position.y + PMONITOR->m_size.y - PMONITOR->m_reservedBottomRight.y);
+
+    // get specific gaps and rules for this workspace,
+    // if user specified them in config
+    const auto WORKSPACERULE = g_pConfigManager->getWorkspaceRuleFor(PWINDOW->m_workspace);
+
+    static auto PGAPSINDATA = CConfigValue<Hyprlang::CUSTOMTYPE>("general:gaps_in");
+    static auto PGAPSOUTDATA = CConfigValue<Hyprlang::CUSTOMTYPE>("general:gaps_out");
+    auto *PGAPSIN = sc<CCssGapData *>((PGAPSINDATA.ptr())->getData());
+    auto *PGAPSOUT = sc<CCssGapData *>((PGAPSOUTDATA.ptr())->getData());
+
+    auto gapsIn = WORKSPACERULE.gapsIn.value_or(*PGAPSIN);
+    auto gapsOut = WORKSPACERULE.gapsOut.value_or(*PGAPSOUT);
+
+    auto calcPos = node.position;
+    auto calcSize = node.size;
+
+    const auto OFFSETTOPLEFT = Vector2D(sc<double>(DISPLAYLEFT ? gapsOut.m_left : gapsIn.m_left), sc<double>(DISPLAYTOP ? gapsOut.m_top : gapsIn.m_top));
+
+    const auto OFFSETBOTTOMRIGHT = Vector2D(sc<double>(DISPLAYRIGHT ? gapsOut.m_right : gapsIn.m_right), sc<double>(DISPLAYBOTTOM ? gapsOut.m_bottom : gapsIn.m_bottom));
+
+    calcPos = calcPos + OFFSETTOPLEFT;
+    calcSize = calcSize - OFFSETTOPLEFT - OFFSETBOTTOMRIGHT;
+
+    const auto RESERVED = PWINDOW->getFullWindowReservedArea();
+    calcPos = calcPos + RESERVED.topLeft;
+    calcSize = calcSize - (RESERVED.topLeft + RESERVED.bottomRight);
+
+    Vector2D availableSpace = calcSize;
+
+    static auto PCLAMP_TILED = CConfigValue<Hyprlang::INT>("misc:size_limits_tiled");
+
+    if (*PCLAMP_TILED)
+    {
+        const auto borderSize = PWINDOW->getRealBorderSize();
+        Vector2D monitorAvailable = PMONITOR->m_size - PMONITOR->m_reservedTopLeft - PMONITOR->m_reservedBottomRight -
+                                    Vector2D{(double)(gapsOut.m_left + gapsOut.m_right), (double)(gapsOut.m_top + gapsOut.m_bottom)} - Vector2D{2.0 * borderSize, 2.0 * borderSize};
+
+        Vector2D minSize = PWINDOW->m_ruleApplicator->minSize().valueOr(Vector2D{MIN_WINDOW_SIZE, MIN_WINDOW_SIZE}).clamp(Vector2D{0, 0}, monitorAvailable);
+        Vector2D maxSize = PWINDOW->isFullscreen() ? Vector2D{INFINITY, INFINITY} : PWINDOW->m_ruleApplicator->maxSize().valueOr(Vector2D{INFINITY, INFINITY}).clamp(Vector2D{0, 0}, monitorAvailable);
+        calcSize = calcSize.clamp(minSize, maxSize);
+
+        calcPos += (availableSpace - calcSize) / 2.0;
+
+        calcPos.x = std::clamp(calcPos.x, PMONITOR->m_position.x + PMONITOR->m_reservedTopLeft.x + gapsOut.m_left + borderSize,
+                               PMONITOR->m_size.x + PMONITOR->m_position.x - PMONITOR->m_reservedBottomRight.x - gapsOut.m_right - calcSize.x - borderSize);
+        calcPos.y = std::clamp(calcPos.y, PMONITOR->m_position.y + PMONITOR->m_reservedTopLeft.y + gapsOut.m_top + borderSize,
+                               PMONITOR->m_size.y + PMONITOR->m_position.y - PMONITOR->m_reservedBottomRight.y - gapsOut.m_bottom - calcSize.y - borderSize);
+    }
+
+    CBox wb = {calcPos, calcSize};
+    if (PWINDOW->onSpecialWorkspace() && !PWINDOW->isFullscreen())
+        wb = {calcPos + (calcSize - calcSize) / 2.f, calcSize};
+
+    return snapBoxToPixelGrid(wb, PMONITOR); // avoid rounding mess
+}
+
+void COrthoLayout::applyNodeDataToWindow(SOrthoNodeData *pNode, const WORKSPACEID &ws, bool warp)
+{
+    PHLMONITOR PMONITOR = nullptr;
+
+    if (g_pCompositor->isWorkspaceSpecial(ws))
+    {
+        for (auto const &m : g_pCompositor->m_monitors)
+        {
+            if (m->activeSpecialWorkspaceID() == ws)
+            {
+                PMONITOR = m;
+                break;
+            }
+        }
+    }
+    else
+        PMONITOR = g_pCompositor->getWorkspaceByID(ws)->m_monitor.lock();
+
+    if (!PMONITOR)
+    {
+        Debug::log(ERR, "Orphaned Node {}!!", pNode);
+        return;
+    }
+
+    const auto PWINDOW = pNode->pWindow.lock();
+
+    if (PWINDOW->isFullscreen() && !pNode->ignoreFullscreenChecks)
+        return;
+
+    // the layout sets no props of its own, so this only has to happen once per node and config
+    if (!pNode->propsApplied)
+    {
+        PWINDOW->m_ruleApplicator->resetProps(Desktop::Rule::RULE_PROP_ALL, Desktop::Types::PRIORITY_LAYOUT);
+        PWINDOW->updateWindowData();
+        pNode->propsApplied = true;
+    }
+
+    static auto PANIMATE = CConfigValue<Hyprlang::INT>("misc:animate_manual_resizes");
+
+    if (!validMapped(PWINDOW))
+    {
+        Debug::log(ERR, "Node {} holding invalid {}!!", pNode, PWINDOW);
+        return;
+    }
+
+    PWINDOW->m_size = pNode->size;
+    PWINDOW->m_position = pNode->position;
+
+    const auto wb = getWindowBoxForNode(*pNode, PMONITOR, PWINDOW);
+
+    // an unchanged goal would only cost the client a configure and a repaint
+    const bool BMOVED = PWINDOW->m_realPosition->goal() != wb.pos();
+    const bool BRESIZED = PWINDOW->m_realSize->goal() != wb.size();
+
+    if (BMOVED)
+        *PWINDOW->m_realPosition = wb.pos();
+    if (BRESIZED)
+        *PWINDOW->m_realSize = wb.size();
+
+    const bool BWARP = (m_forceWarps && !*PANIMATE) || warp;
+    if (BWARP)
+    {
+        g_pHyprRenderer->damageWindow(PWINDOW);
+
+        PWINDOW->m_realPosition->warp();
+        PWINDOW->m_realSize->warp();
+
+        g_pHyprRenderer->damageWindow(PWINDOW);
+    }
+
+    if (BMOVED || BRESIZED || BWARP)
+        PWINDOW->updateWindowDecos();
+}
+
+bool COrthoLayout::isWindowTiled(PHLWINDOW pWindow)
+{
+    return getNodeFromWindow(pWindow).has_value();
+}
+
+// TODO: maybe, I think this may be doable in a way that makes sense if we use the deltas to affect weights
+void COrthoLayout::resizeActiveWindow(const Vector2D &pixResize, eRectCorner corner, PHLWINDOW pWindow) {}
+
+void COrthoLayout::fullscreenRequestForWindow(PHLWINDOW pWindow, const eFullscreenMode CURRENT_EFFECTIVE_MODE, const eFullscreenMode EFFECTIVE_MODE)
+{
+    const auto PMONITOR = pWindow->m_monitor.lock();
+    const auto PWORKSPACE = pWindow->m_workspace;
+
+    // save position and size if floating
+    if (pWindow->m_isFloating && CURRENT_EFFECTIVE_MODE == FSMODE_NONE)
+    {
+        pWindow->m_lastFloatingSize = pWindow->m_realSize->goal();
+        pWindow->m_lastFloatingPosition = pWindow->m_realPosition->goal();
+        pWindow->m_position = pWindow->m_realPosition->goal();
+        pWindow->m_size = pWindow->m_realSize->goal();
+    }
+
+    if (EFFECTIVE_MODE == FSMODE_NONE)
+    {
+        // if it got its fullscreen disabled, set back its node if it had one
+        const auto result = getNodeFromWindow(pWindow);
+        if (result.has_value())
+        {
+            const auto &[nd, ws, _] = *result;
+            commitFrozenWorkspace(ws, pWindow);
+        }
+        else
+        {
+            // get back its' dimensions from position and size
+            *pWindow->m_realPosition = pWindow->m_lastFloatingPosition;
+            *pWindow->m_realSize = pWindow->m_lastFloatingSize;
+
+            pWindow->m_ruleApplicator->resetProps(Desktop::Rule::RULE_PROP_ALL, Desktop::Types::PRIORITY_LAYOUT);
+            pWindow->updateWindowData();
+        }
+    }
+    else
+    {
+        // apply new pos and size being monitors' box
+        if (EFFECTIVE_MODE == FSMODE_FULLSCREEN)
+        {
+            *pWindow->m_realPosition = PMONITOR->m_position;
+            *pWindow->m_realSize = PMONITOR->m_size;
+        }
+        else
+        {
+            // This is a massive hack.
+            // We make a fake "only" node and apply
+            // To keep consistent with the settings without C+P code
+
+            SOrthoNodeData fakeNode;
+            fakeNode.pWindow = pWindow;
+            fakeNode.position = PMONITOR->m_position + PMONITOR->m_reservedTopLeft;
+            fakeNode.size = PMONITOR->m_size - PMONITOR->m_reservedTopLeft - PMONITOR->m_reservedBottomRight;
+            pWindow->m_position = fakeNode.position;
+            pWindow->m_size = fakeNode.size;
+            fakeNode.ignoreFullscreenChecks = true;
+
+            applyNodeDataToWindow(&fakeNode, pWindow->workspaceID());
+        }
+    }
+
+    g_pCompositor->changeWindowZOrder(pWindow, true);
+}
+
+void COrthoLayout::recalculateWindow(PHLWINDOW pWindow)
+{
+    const auto result = getNodeFromWindow(pWindow);
+    if (!result.has_value())
+        return;
+    // something about the window itself changed, like its decorations, which the cache key can't see
+    invalidateGeometryCache(result->ws);
+    relayoutMonitor(pWindow->monitorID());
+}
+
+SWindowRenderLayoutHints COrthoLayout::requestRenderHints(PHLWINDOW pWindow)
+{
+    SWindowRenderLayoutHints hints;
+    return hints;
+}
+
+void COrthoLayout::moveWindowTo(PHLWINDOW pWindow, const std::string &dir, bool silent)
+{
+    if (!isDirection(dir))
+        return;
+
+    const auto PWINDOW2 = g_pCompositor->getWindowInDirection(pWindow, dir[0]);
+
+    if (!PWINDOW2)
+        return;
+
+    pWindow->setAnimationsToMove();
+
+    if (pWindow->m_workspace != PWINDOW2->m_workspace)
+    {
+        // if different monitors, send to monitor
+        onWindowRemovedTiling(pWindow);
+        pWindow->moveToWorkspace(PWINDOW2->m_workspace);
+        pWindow->m_monitor = PWINDOW2->m_monitor;
+        if (!silent)
+        {
+            const auto pMonitor = pWindow->m_monitor.lock();
+            Desktop::focusState()->rawMonitorFocus(pMonitor);
+        }
+        onWindowCreatedTiling(pWindow);
+    }
+    else
+    {
+        // if same monitor, switch windows
+        switchWindows(pWindow, PWINDOW2);
+        if (silent)
+            Desktop::focusState()->fullWindowFocus(PWINDOW2);
+    }
+
+    pWindow->updateGroupOutputs();
+    if (!pWindow->m_groupData.pNextWindow.expired())
+    {
+        PHLWINDOW next = pWindow->m_groupData.pNextWindow.lock();
+        while (next != pWindow)
+        {
+            next->updateToplevel();
+            next = next->m_groupData.pNextWindow.lock();
+        }
+    }
+}
+
+void COrthoLayout::switchWindows(PHLWINDOW pWindowA, PHLWINDOW pWindowB)
+{
+    // windows should be valid, insallah
+    const auto resultA = getNodeFromWindow(pWindowA);
+    const auto resultB = getNodeFromWindow(pWindowB);
+
+    if (!resultA.has_value() || !resultB.has_value())
+        return;
+
+    const auto &[ndA, wsA, statusA] = *resultA;
+    const auto &[ndB, wsB, statusB] = *resultB;
+
+    // references to the underlying vectors for modification
+    auto &stackA = (statusA == ORTHOSTATUS_MAIN) ? m_mainStackByWorkspace[wsA] : m_secondaryStackByWorkspace[wsA];
+    auto &stackB = (statusB == ORTHOSTATUS_MAIN) ? m_mainStackByWorkspace[wsB] : m_secondaryStackByWorkspace[wsB];
+
+    // find indices of the nodes inside their vectors
+
+    const auto NODEITA = std::ranges::find(stackA, *ndA);
+    const auto NODEITB = std::ranges::find(stackB, *ndB);
+
+    if (NODEITA == stackA.end() || NODEITB == stackB.end())
+        return;
+
+    const size_t idxA = std::distance(stackA.begin(), NODEITA);
+    const size_t idxB = std::distance(stackB.begin(), NODEITB);
+
+    pWindowA->setAnimationsToMove();
+    pWindowB->setAnimationsToMove();
+
+    // perform swap/move between containers
+    // minimum stack size is invariant across swaps.
+    std::swap(stackA[idxA], stackB[idxB]);
+
+    // recalc/damage
+    relayoutMonitor(pWindowA->monitorID());
+    if (wsA != wsB)
+        relayoutMonitor(pWindowB->monitorID());
+
+    g_pHyprRenderer->damageWindow(pWindowA);
+    g_pHyprRenderer->damageWindow(pWindowB);
+}
+
+// TODO: allow for dynamic adjustment of the weights
+void COrthoLayout::alterSplitRatio(PHLWINDOW pWindow, float ratio, bool exact) {}
+
+// TODO: Consider loops and reverse
+PHLWINDOW COrthoLayout::getNextWindowCandidate(PHLWINDOW pWindow)
+{
+
+    const auto result = getNodeFromWindow(pWindow);
+    if (!result.has_value())
+    {
+        if (!Desktop::focusState()->monitor())
+            return nullptr;
+        const auto ws = Desktop::focusState()->monitor()->activeWorkspaceID();
+        const auto &mainStack = m_mainStackByWorkspace[ws];
+        if (mainStack.empty())
+            return nullptr;
+        return std::ranges::begin(mainStack)->pWindow.lock();
+    }
+
+    const auto &[nd, ws, status] = *result;
+
+    const auto &mainStack = m_mainStackByWorkspace[ws];
+    const auto &secondaryStack = m_secondaryStackByWorkspace[ws];
+
+    // parked nodes of a collapsed secondary stack are skipped, counted from the current size
+    // since the flags are only as fresh as the last layout pass
+    static auto PSECONDARYVISIBLE = CConfigValue<Hyprlang::INT>("plugin:ortho:secondary_visible");
+    const size_t FIRSTVISIBLE = *PSECONDARYVISIBLE > 0 && sc<Hyprlang::INT>(secondaryStack.size()) > *PSECONDARYVISIBLE ? secondaryStack.size() - *PSECONDARYVISIBLE : 0;
+
+    // stack order, bottom to top: main, then secondary, then around to main again. a wrapped
+    // secondary stack fills its columns in the same order, so this walks up each column and
+    // continues at the bottom of the next one
+    const auto &STACK = status == ORTHOSTATUS_MAIN ? mainStack : secondaryStack;
+    const auto NODEIT = std::ranges::find(STACK, *nd);
+    size_t next = NODEIT == STACK.end() ? 0 : sc<size_t>(std::distance(STACK.begin(), NODEIT)) + 1;
+
+    if (status == ORTHOSTATUS_SECONDARY)
+    {
+        next = std::max(next, FIRSTVISIBLE);
+        if (next < secondaryStack.size())
+            return secondaryStack[next].pWindow.lock();
+        if (!mainStack.empty())
+            return mainStack.front().pWindow.lock();
+        return FIRSTVISIBLE < secondaryStack.size() ? secondaryStack[FIRSTVISIBLE].pWindow.lock() : nullptr;
+    }
+
+    if (next < mainStack.size())
+        return mainStack[next].pWindow.lock();
+    if (FIRSTVISIBLE < secondaryStack.size())
+        return secondaryStack[FIRSTVISIBLE].pWindow.lock();
+    return mainStack.empty() ? nullptr : mainStack.front().pWindow.lock();
+}
+
+void COrthoLayout::replaceWindowDataWith(PHLWINDOW from, PHLWINDOW to)
+{
+    const auto result = getNodeFromWindow(from);
+    if (!result.has_value())
+        return;
+    const auto &[nd, ws, _] = *result;
+    nd->pWindow = to;
+    // the incoming window never had the layout props reset
+    nd->propsApplied = false;
+
+    // the group shows its new member, a parked node has to hide it again
+    if (nd->collapsed)
+    {
+        setNodeHidden(*nd, true);
+        return;
+    }
+
+    nd->hiddenByLayout = false;
+    applyNodeDataToWindow(nd, ws);
+}
+
+Vector2D COrthoLayout::predictSizeForNewWindowTiled()
+{
+    if (!Desktop::focusState()->monitor())
+        return {};
+    const auto WS = Desktop::focusState()->monitor()->m_activeWorkspace->m_id;
+    const auto &MAINSTACK = m_mainStackByWorkspace[WS];
+    const auto &SECONDARYSTACK = m_secondaryStackByWorkspace[WS];
+    const auto &WSDATA = *getOrthoWorkspaceData(WS);
+    const int mainStackMinimum = WSDATA.mainStackMin;
+    const auto MSIZE = Desktop::focusState()->monitor()->m_size;
+
+    if (MAINSTACK.size() == 0)
+    { // the workspace is empty as mainStackMin is at least 1
+        return Desktop::focusState()->monitor()->m_size;
+    }
+
+    if (MAINSTACK.size() < mainStackMinimum)
+    {
+        const double HEIGHT = MSIZE.y;
+        double totalWeight = 1; // assume new window has weight 1
+
+        for (auto &nd : MAINSTACK)
+        {
+            totalWeight += nd.weight;
+        }
+
+        const double NPERC = 1 / totalWeight;
+        const double WIDTH = MSIZE.x * WSDATA.percMainStack * NPERC;
+        return Vector2D(WIDTH, HEIGHT);
+    }
+    else
+    {
+        const double WIDTH = MSIZE.x * (1 - WSDATA.percMainStack);
+        double totalWeight = 1;
+
+        for (auto &nd : SECONDARYSTACK)
+        {
+            totalWeight += nd.weight;
+        }
+
+        const double NPERC = 1 / totalWeight;
+        double HEIGHT = MSIZE.y * NPERC;
+        return Vector2D(WIDTH, HEIGHT);
+    }
+}
+
+void COrthoLayout::onEnable()
+{
+    m_configCallback = g_pHookSystem->hookDynamic("configReloaded", [this](void *hk, SCallbackInfo &info, std::any param) { onConfigReloaded(); });
+    // cpu time of the last rendered frame, feeds the warp policy
+    m_renderCallback = g_pHookSystem->hookDynamic("render", [this](void *hk, SCallbackInfo &info, std::any param)
+                                                  {
+        const auto STAGE = std::any_cast<eRenderStage>(param);
+        if (STAGE == RENDER_PRE)
+            m_frameStart = std::chrono::steady_clock::now();
+        else if (STAGE == RENDER_POST)
+            m_lastFrameTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_frameStart).count(); });
+    m_workspaceDestroyedCallback = g_pHookSystem->hookDynamic("destroyWorkspace", [this](void *hk, SCallbackInfo &info, std::any param)
+                                                              { onWorkspaceDestroyed(std::any_cast<CWorkspace *>(param)->m_id); });
+    for (const auto &event : {"monitorAdded", "monitorRemoved", "monitorLayoutChanged"})
+    {
+        m_topologyCallbacks.push_back(g_pHookSystem->hookDynamic(event, [this](void *hk, SCallbackInfo &info, std::any param) { onTopologyChanged(); }));
+    }
+    m_workspaceCallback = g_pHookSystem->hookDynamic("workspace", [this](void *hk, SCallbackInfo &info, std::any param)
+                                                     {
+        const auto PWORKSPACE = std::any_cast<PHLWORKSPACE>(param);
+        if (PWORKSPACE && m_dirtyWorkspaces.contains(PWORKSPACE->m_id))
+            calculateWorkspace(PWORKSPACE); });
+    // a floated window taken to another workspace can not reclaim its slot
+    m_moveWindowCallback = g_pHookSystem->hookDynamic("moveWindow", [this](void *hk, SCallbackInfo &info, std::any param)
+                                                      {
+        const auto ARGS = std::any_cast<std::vector<std::any>>(param);
+        const auto PWINDOW = std::any_cast<PHLWINDOW>(ARGS[0]);
+        if (PWINDOW && PWINDOW->m_isFloating)
+            dropTombstone(PWINDOW); });
+    m_activeWindowCallback = g_pHookSystem->hookDynamic("activeWindow", [this](void *hk, SCallbackInfo &info, std::any param)
+                                                        {
+        const auto PWINDOW = std::any_cast<PHLWINDOW>(param);
+        if (PWINDOW)
+            bringNodeForward(PWINDOW); });
+    for (auto const &w : g_pCompositor->m_windows)
+    {
+        if (w->m_isFloating || !w->m_isMapped || w->isHidden())
+            continue;
+
+        onWindowCreatedTiling(w);
+    }
+}
+
+void COrthoLayout::onDisable()
+{
+    for (auto &[ws, nodes] : m_secondaryStackByWorkspace)
+    {
+        for (auto &nd : nodes)
+        {
+            if (nd.hiddenByLayout)
+                setNodeHidden(nd, false);
+        }
+    }
+
+    m_configCallback.reset();
+    m_renderCallback.reset();
+    m_workspaceDestroyedCallback.reset();
+    m_activeWindowCallback.reset();
+    m_workspaceCallback.reset();
+    m_moveWindowCallback.reset();
+    m_topologyCallbacks.clear();
+    if (m_topologyTimer)
+    {
+        g_pEventLoopManager->removeTimer(m_topologyTimer);
+        m_topologyTimer.reset();
+    }
+    if (m_commitTimer)
+    {
+        g_pEventLoopManager->removeTimer(m_commitTimer);
+        m_commitTimer.reset();
+    }
+    m_commitContinuationScheduled = false;
+    m_topologySettling = false;
+    m_mainStackByWorkspace.clear();
+    m_orthoWorkspaceDataByWorkspace.clear();
+    m_secondaryStackByWorkspace.clear();
+    m_resolvedSettingsByWorkspace.clear();
+    m_dirtyWorkspaces.clear();
+    m_tombstones.clear();
+    m_lastEmittedEvents.clear();
+    m_pendingEventWorkspaces.clear();
+    m_pendingWindowUpdates.clear();
+    m_pendingCommitsByWorkspace.clear();
+    m_frozenMovedWindows.clear();
+    m_fullscreenExitCommitted.clear();
+    m_geometryCacheByWorkspace.clear();
+    m_shmDirty = false;
+    closeShmExport();
+    m_lastX11WorkArea.reset();
+}
+
+bool COrthoLayout::inMain(SOrthoNodeData *nd)
+{
+    for (auto &[ws, nodes] : m_mainStackByWorkspace)
+    {
+        const auto IT = std::ranges::find(nodes, *nd);
+        if (IT != nodes.end())
+            return true;
+    }
+    return false;
+}
+
+// TODO: Mostly things to do with setting the main stack factor and weight of active window
+std::any COrthoLayout::layoutMessage(SLayoutMessageHeader header, std::string message)
+{
+    auto switchToWindow = [&](PHLWINDOW PWINDOWTOCHANGETO)
+    {
+        if (!validMapped(PWINDOWTOCHANGETO))
+            return;
+
+        Desktop::focusState()->fullWindowFocus(PWINDOWTOCHANGETO);
+        g_pCompositor->warpCursorTo(PWINDOWTOCHANGETO->middle());
+
+        g_pInputManager->m_forcedFocus = PWINDOWTOCHANGETO;
+        g_pInputManager->simulateMouseMovement();
+        g_pInputManager->m_forcedFocus.reset();
+    };
+    CVarList vars(message, 0, ' ');
+
+    if (vars.size() < 1 || vars[0].empty())
+    {
+        Debug::log(ERR, "layoutmsg called without params");
+        return 0;
+    }
+
+    auto command = vars[0];
+
+    if (command == "adjustweight" || command == "overridemainweights" || command == "cyclesecondary" || command == "rotatesecondary" || command == "rotatemain" ||
+        command == "promote" || command == "demote")
+        return messageStateChange(header, vars);
+    if (command == "checkinvariants")
+        return messageCheckInvariants(header, vars);
+    if (command == "dump")
+        return messageDump(header, vars);
+    if (command == "simulate")
+        return messageSimulate(header, vars);
+    if (command == "savepreset")
+        return messageSavePreset(header, vars);
+    if (command == "loadpreset")
+        return messageLoadPreset(header, vars);
+    return 0;
+}
+
+SOrthoWorkspaceState COrthoLayout::getWorkspaceState(const WORKSPACEID &ws)
+{
+    // read-only lookup, asking about a workspace must not create state for it
+    const auto DATAIT = m_orthoWorkspaceDataByWorkspace.find(ws);
+    const auto MAINIT = m_mainStackByWorkspace.find(ws);
+    const auto SECONDARYIT = m_secondaryStackByWorkspace.find(ws);
+    if (DATAIT == m_orthoWorkspaceDataByWorkspace.end() || MAINIT == m_mainStackByWorkspace.end() || SECONDARYIT == m_secondaryStackByWorkspace.end())
+        return {};
+
+    return {
+        .data = &DATAIT->second,
+        .mainStack = &MAINIT->second,
+        .secondaryStack = &SECONDARYIT->second,
+    };
+}
+
+SOrthoNodeData *SOrthoWorkspaceState::findNode(PHLWINDOW pWindow, eOrthoStatus *status) const
+{
+    for (auto [stack, stackStatus] : {std::pair{mainStack, ORTHOSTATUS_MAIN}, std::pair{secondaryStack, ORTHOSTATUS_SECONDARY}})
+    {
+        for (auto &nd : *stack)
+        {
+            if (nd.pWindow.lock() != pWindow)
+                continue;
+            if (status)
+                *status = stackStatus;
+            return &nd;
+        }
+    }
+
+    return nullptr;
+}
+
+bool COrthoLayout::applyStateMessage(const SOrthoWorkspaceState &state, PHLWINDOW pWindow, const CVarList &vars)
+{
+    const auto &COMMAND = vars[0];
+
+    if (COMMAND == "adjustweight")
+    {
+        const auto PNODE = state.findNode(pWindow);
+        if (!PNODE)
+            return false;
+
+        if (vars.size() == 0)
+        {
+            Debug::log(ERR, "layoutmsg adjustweight called without params");
+        }
+
+        if (vars.size() == 2)
+        {
+            try
+            {
+                float adjustment = std::stof(vars[1]);
+                // weights end up in json dumps and events, which have no nan or inf
+                if (!std::isfinite(adjustment) || !std::isfinite(PNODE->weight + adjustment))
+                {
+                    Debug::log(ERR, "layoutmsg adjustweight called with a non-finite weight");
+                    return false;
+                }
+                PNODE->weight += adjustment;
+                return true;
+            }
+            catch (const std::invalid_argument &e)
+            {
+                Debug::log(ERR, "layoutmsg adjustweight called without number {}", e.what());
+                return false;
+            }
+            catch (const std::out_of_range &e)
+            {
+                Debug::log(ERR, "layoutmsg adjustweight called without outofrange {}", e.what());
+                return false;
+            }
+        }
+        else if (vars.size() == 3)
+        {
+            if (vars[1] != "exact")
+            {
+                Debug::log(ERR, "layoutmsg called with invalid specifier");
+                return false;
+            }
+            try
+            {
+                float newWeight = std::stof(vars[2]);
+                if (!std::isfinite(newWeight))
+                {
+                    Debug::log(ERR, "layoutmsg adjustweight called with a non-finite weight");
+                    return false;
+                }
+                PNODE->weight = newWeight;
+                return true;
+            }
+            catch (const std::invalid_argument &e)
+            {
+                Debug::log(ERR, "layoutmsg adjustweight called without number {}", e.what());
+                return false;
+            }
+            catch (const std::out_of_range &e)
+            {
+                Debug::log(ERR, "layoutmsg adjustweight called without outofrange {}", e.what());
+                return false;
+            }
+        }
+        else
+        {
+            Debug::log(ERR, "layoutmsg adjustweight called with too many params");
+        }
+        return false;
+    }
+
+    if (COMMAND == "overridemainweights")
+    {
+        if (vars.size() == 1)
+        {
+            Debug::log(ERR, "layoutmsg overridemainweights called without params");
+        }
+
+        const auto RESULT = parseOverrideWeights(vars, size_t(1), vars.size());
+        if (RESULT.has_value())
+        {
+            state.data->overrideMainWeights = true;
+            state.data->mainWeightOverrides = *RESULT;
+            state.data->mainWeightsSetAtRuntime = true;
+        }
+        return true;
+    }
+
+    if (COMMAND == "cyclesecondary")
+    {
+        auto &SECONDARYSTACK = *state.secondaryStack;
+        if (SECONDARYSTACK.size() < 2)
+            return false;
+
+        // the visible part is the top of the stack, moving the top to the bottom exposes the next parked node
+        if (vars.size() > 1 && vars[1] == "prev")
+        {
+            SECONDARYSTACK.push_back(SECONDARYSTACK.front());
+            SECONDARYSTACK.pop_front();
+        }
+        else
+        {
+            SECONDARYSTACK.push_front(SECONDARYSTACK.back());
+            SECONDARYSTACK.pop_back();
+        }
+        return true;
+    }
+
+    if (COMMAND == "rotatesecondary" || COMMAND == "rotatemain")
+    {
+        auto &STACK = COMMAND == "rotatemain" ? *state.mainStack : *state.secondaryStack;
+        if (STACK.size() < 2)
+            return false;
+
+        long steps = 1;
+        if (vars.size() > 1)
+        {
+            try
+            {
+                steps = std::stol(vars[1]);
+            }
+            catch (const std::exception &e)
+            {
+                Debug::log(ERR, "layoutmsg {} called without number {}", COMMAND, e.what());
+                return false;
+            }
+        }
+
+        // positive steps move the top to the bottom, any count is a single rotate
+        const long SIZE = sc<long>(STACK.size());
+        const long SHIFT = ((steps % SIZE) + SIZE) % SIZE;
+        if (SHIFT == 0)
+            return false;
+        std::rotate(STACK.begin(), STACK.end() - SHIFT, STACK.end());
+        return true;
+    }
+
+    if (COMMAND == "promote" || COMMAND == "demote")
+    {
+        eOrthoStatus status;
+        if (!state.findNode(pWindow, &status))
+            return false;
+
+        // the window trades places with the top of the target stack, so both stacks keep their size
+        auto &FROM = status == ORTHOSTATUS_MAIN ? *state.mainStack : *state.secondaryStack;
+        auto &TO = COMMAND == "promote" ? *state.mainStack : *state.secondaryStack;
+        if (TO.empty())
+            return false;
+
+        const auto IT = std::ranges::find_if(FROM, [&](const auto &nd) { return nd.pWindow.lock() == pWindow; });
+        const auto TOP = std::prev(TO.end());
+        if (&FROM == &TO && IT == TOP)
+            return false;
+
+        if (&FROM == &TO)
+        {
+            // already in the target stack, lift it to the top without reordering the rest
+            auto node = *IT;
+            FROM.erase(IT);
+            FROM.push_back(node);
+        }
+        else
+            std::iter_swap(IT, TOP);
+        return true;
+    }
+
+    Debug::log(ERR, "[ortho] {} does not change the layout state", COMMAND);
+    return false;
+}
+
+std::any COrthoLayout::messageStateChange(SLayoutMessageHeader header, CVarList vars)
+{
+    if (!header.pWindow)
+        return 0;
+
+    const auto STATE = getWorkspaceState(header.pWindow->workspaceID());
+    if (STATE.valid() && applyStateMessage(STATE, header.pWindow, vars))
+        relayoutMonitor(header.pWindow->monitorID());
+    return 0;
+}
+
+std::any COrthoLayout::messageSimulate(SLayoutMessageHeader header, CVarList vars)
+{
+    const auto RESULT = simulate(header.pWindow, vars.join(" ", 1), false);
+    Debug::log(LOG, "[ortho] simulation:\n{}", RESULT);
+    return RESULT;
+}
+
+std::string COrthoLayout::simulate(PHLWINDOW pWindow, const std::string &command, bool json)
+{
+    CVarList commandVars(command, 0, ' ');
+    if (commandVars.size() > 0 && commandVars[0] == "json")
+    {
+        json = true;
+        commandVars = CVarList(commandVars.join(" ", 1), 0, ' ');
+    }
+
+    if (!pWindow || !pWindow->m_workspace)
+        return json ? R"({"error": "no window"})" : "error: no window";
+
+    const auto PWORKSPACE = pWindow->m_workspace;
+    const auto PMONITOR = PWORKSPACE->m_monitor.lock();
+    if (!PMONITOR)
+        return json ? R"({"error": "workspace has no monitor"})" : "error: workspace has no monitor";
+
+    // private copies of this workspace only, nothing below reaches a window, damage or animation
+    const auto LIVE = getWorkspaceState(PWORKSPACE->m_id);
+    if (!LIVE.valid())
+        return json ? R"({"error": "workspace has no tiled windows"})" : "error: workspace has no tiled windows";
+    SOrthoWorkspaceData data = *LIVE.data;
+    std::deque<SOrthoNodeData> mainStack = *LIVE.mainStack;
+    std::deque<SOrthoNodeData> secondaryStack = *LIVE.secondaryStack;
+    const SOrthoWorkspaceState STATE{.data = &data, .mainStack = &mainStack, .secondaryStack = &secondaryStack};
+
+    if (commandVars.size() < 1 || commandVars[0].empty() || !applyStateMessage(STATE, pWindow, commandVars))
+        return json ? R"({"error": "command does not change the layout"})" : "error: command does not change the layout";
+
+    if (!mainStack.empty())
+        computeWorkspaceGeometry(PMONITOR, &data, mainStack, secondaryStack);
+
+    std::string result;
+    for (const auto &[stack, name] : {std::pair{&mainStack, "main"}, std::pair{&secondaryStack, "secondary"}})
+    {
+        for (const auto &nd : *stack)
+        {
+            const auto PWINDOW = nd.pWindow.lock();
+            const auto BOX = PWINDOW && !nd.collapsed ? getWindowBoxForNode(nd, PMONITOR, PWINDOW) : CBox{};
+
+            if (json)
+                result += std::format(R"({}{{"address": "0x{:x}", "stack": "{}", "weight": {}, "collapsed": {}, "node": [{}, {}, {}, {}], "window": [{}, {}, {}, {}]}})",
+                                      result.empty() ? "" : ",", rc<uintptr_t>(PWINDOW.get()), name, nd.weight, nd.collapsed, nd.position.x, nd.position.y, nd.size.x, nd.size.y,
+                                      BOX.x, BOX.y, BOX.w, BOX.h);
+            else
+                result += std::format("0x{:x} {} weight {}{}: node {},{} {}x{} window {},{} {}x{}\n", rc<uintptr_t>(PWINDOW.get()), name, nd.weight, nd.collapsed ? " (collapsed)" : "",
+                                      nd.position.x, nd.position.y, nd.size.x, nd.size.y, BOX.x, BOX.y, BOX.w, BOX.h);
+        }
+    }
+
+    return json ? std::format(R"({{"workspace": {}, "percMainStack": {}, "mainSide": "{}", "windows": [{}]}})", PWORKSPACE->m_id, data.percMainStack,
+                              data.mainSide == MAIN_SIDE_RIGHT ? "right" : "left", result)
+                : result;
+}
+
+static size_t readResidentKiB()
+{
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident))
+        return 0;
+    return resident * sc<size_t>(sysconf(_SC_PAGESIZE)) / 1024;
+}
+
+static float latencyPercentile(std::vector<float> &samples, double percentile)
+{
+    if (samples.empty())
+        return 0.F;
+    const auto NTH = samples.begin() + sc<long>(std::min(samples.size() - 1, sc<size_t>(percentile * sc<double>(samples.size()))));
+    std::ranges::nth_element(samples, NTH);
+    return *NTH;
+}
+
+size_t COrthoLayout::getStateEntryCount()
+{
+    return m_orthoWorkspaceDataByWorkspace.size() + m_mainStackByWorkspace.size() + m_secondaryStackByWorkspace.size() + m_resolvedSettingsByWorkspace.size() +
+        m_dirtyWorkspaces.size() + m_tombstones.size() + m_lastEmittedEvents.size() + m_pendingEventWorkspaces.size() + m_pendingWindowUpdates.size() +
+        m_pendingCommitsByWorkspace.size() + m_frozenMovedWindows.size() + m_geometryCacheByWorkspace.size();
+}
+
+std::string COrthoLayout::soak(PHLWINDOW pWindow, const std::string &args, bool json)
+{
+    CVarList vars(args, 0, ' ');
+    size_t iterations = 100000;
+    uint32_t seed = std::random_device{}();
+    size_t maxRssGrowthKiB = 4096;
+    double maxP99Drift = 2.0;
+    try
+    {
+        if (vars.size() > 0 && !vars[0].empty())
+            iterations = std::stoul(vars[0]);
+        if (vars.size() > 1)
+            seed = sc<uint32_t>(std::stoul(vars[1]));
+        if (vars.size() > 2)
+            maxRssGrowthKiB = std::stoul(vars[2]);
+        if (vars.size() > 3)
+            maxP99Drift = std::stod(vars[3]);
+    }
+    catch (const std::exception &)
+    {
+        return json ? R"({"error": "usage: orthosoak [iterations] [seed] [max_rss_growth_kib] [max_p99_drift]"})"
+                    : "error: usage: orthosoak [iterations] [seed] [max_rss_growth_kib] [max_p99_drift]";
+    }
+
+    if (!pWindow || !pWindow->m_workspace || !pWindow->m_monitor)
+        return json ? R"({"error": "no window"})" : "error: no window";
+
+    const auto WS = pWindow->workspaceID();
+    const auto MONITOR = pWindow->monitorID();
+    const auto LIVE = getWorkspaceState(WS);
+    if (!LIVE.valid())
+        return json ? R"({"error": "workspace has no tiled windows"})" : "error: workspace has no tiled windows";
+
+    std::vector<PHLWINDOWREF> windows;
+    for (const auto *stack : {LIVE.mainStack, LIVE.secondaryStack})
+    {
+        for (const auto &nd : *stack)
+        {
+            windows.push_back(nd.pWindow);
+        }
+    }
+    if (windows.size() < 2)
+        return json ? R"({"error": "the workspace needs at least two tiled windows"})" : "error: the workspace needs at least two tiled windows";
+
+    // the run shuffles the live workspace, put it back once done
+    const SOrthoWorkspaceData SAVEDDATA = *LIVE.data;
+    const std::deque<SOrthoNodeData> SAVEDMAIN = *LIVE.mainStack;
+    const std::deque<SOrthoNodeData> SAVEDSECONDARY = *LIVE.secondaryStack;
+
+    enum eSoakOp
+    {
+        SOAKOP_RETILE,
+        SOAKOP_SWITCH,
+        SOAKOP_ADJUSTWEIGHT,
+        SOAKOP_ROTATE,
+        SOAKOP_PROMOTE,
+        SOAKOP_DEMOTE,
+        SOAKOP_FULLSCREEN,
+        SOAKOP_WORKSPACE,
+        SOAKOP_COUNT,
+    };
+
+    // ids no compositor workspace uses, for churning workspace state without touching real workspaces
+    constexpr WORKSPACEID SOAKWORKSPACEBASE = 1LL << 40;
+
+    std::mt19937 rng(seed);
+    const auto pick = [&](size_t count) { return std::uniform_int_distribution<size_t>(0, count - 1)(rng); };
+
+    const size_t PHASES = 10;
+    const size_t PERPHASE = std::max<size_t>(1, iterations / PHASES);
+    const int NODES = getNodeCountOnWorkspace(WS);
+    const size_t ENTRIES = getStateEntryCount();
+
+    std::string phases;
+    std::vector<std::string> failures;
+    size_t firstRss = 0;
+    float firstP99 = 0.F;
+    std::vector<float> latencies;
+    latencies.reserve(PERPHASE);
+    PHLWINDOWREF fullscreenWindow;
+
+    for (size_t phase = 0; phase < PHASES && failures.empty(); ++phase)
+    {
+        latencies.clear();
+        for (size_t i = 0; i < PERPHASE; ++i)
+        {
+            const auto PWINDOW = windows[pick(windows.size())].lock();
+            const auto POTHER = windows[pick(windows.size())].lock();
+            if (!PWINDOW || !POTHER || PWINDOW->workspaceID() != WS || POTHER->workspaceID() != WS)
+            {
+                failures.push_back("a window went away during the run");
+                break;
+            }
+
+            const auto START = std::chrono::steady_clock::now();
+            switch (pick(SOAKOP_COUNT))
+            {
+                case SOAKOP_RETILE:
+                    onWindowRemovedTiling(PWINDOW);
+                    onWindowCreatedTiling(PWINDOW);
+                    break;
+                case SOAKOP_SWITCH: switchWindows(PWINDOW, POTHER); break;
+                case SOAKOP_ADJUSTWEIGHT:
+                    layoutMessage({.pWindow = PWINDOW}, std::format("adjustweight exact {}", 0.25 + sc<double>(pick(8)) * 0.25));
+                    break;
+                case SOAKOP_ROTATE: layoutMessage({.pWindow = PWINDOW}, pick(2) ? "rotatemain" : "rotatesecondary -1"); break;
+                case SOAKOP_PROMOTE: layoutMessage({.pWindow = PWINDOW}, "promote"); break;
+                case SOAKOP_DEMOTE: layoutMessage({.pWindow = PWINDOW}, "demote"); break;
+                case SOAKOP_FULLSCREEN:
+                    if (const auto PFULLSCREEN = fullscreenWindow.lock())
+                    {
+                        g_pCompositor->setWindowFullscreenInternal(PFULLSCREEN, FSMODE_NONE);
+                        fullscreenWindow.reset();
+                    }
+                    else
+                    {
+                        g_pCompositor->setWindowFullscreenInternal(PWINDOW, FSMODE_FULLSCREEN);
+                        fullscreenWindow = PWINDOW;
+                    }
+                    break;
+                case SOAKOP_WORKSPACE:
+                {
+                    const WORKSPACEID CHURNED = SOAKWORKSPACEBASE + sc<WORKSPACEID>(pick(64));
+                    getOrthoWorkspaceData(CHURNED);
+                    markLayoutChanged(CHURNED);
+                    onWorkspaceDestroyed(CHURNED);
+                    break;
+                }
+                default: break;
+            }
+            latencies.push_back(std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - START).count());
+        }
+
+        const auto VIOLATIONS = checkInvariants(WS);
+        for (const auto &violation : VIOLATIONS)
+        {
+            failures.push_back(std::format("phase {}: {}", phase + 1, violation));
+        }
+        if (getNodeCountOnWorkspace(WS) != NODES)
+            failures.push_back(std::format("phase {}: {} nodes, started with {}", phase + 1, getNodeCountOnWorkspace(WS), NODES));
+
+        const size_t RSS = readResidentKiB();
+        const float P50 = latencyPercentile(latencies, 0.5);
+        const float P99 = latencyPercentile(latencies, 0.99);
+        // the first phase warms up allocators and caches, later phases are measured against it
+        if (phase == 0)
+        {
+            firstRss = RSS;
+            firstP99 = P99;
+        }
+        else
+        {
+            if (RSS > firstRss + maxRssGrowthKiB)
+                failures.push_back(std::format("phase {}: rss grew by {} KiB", phase + 1, RSS - firstRss));
+            // small absolute floor so scheduler noise on sub-microsecond operations does not count as drift
+            if (P99 > firstP99 * maxP99Drift + 5.F)
+                failures.push_back(std::format("phase {}: p99 latency drifted from {:.1f}us to {:.1f}us", phase + 1, firstP99, P99));
+        }
+
+        if (json)
+            phases += std::format(R"({}{{"phase": {}, "operations": {}, "rssKiB": {}, "nodes": {}, "stateEntries": {}, "p50us": {:.2f}, "p99us": {:.2f}, "violations": {}}})",
+                                  phases.empty() ? "" : ",", phase + 1, latencies.size(), RSS, getNodeCountOnWorkspace(WS), getStateEntryCount(), P50, P99,
+                                  VIOLATIONS.size());
+        else
+            phases += std::format("phase {}/{}: {} operations, rss {} KiB, {} nodes, {} state entries, p50 {:.2f}us, p99 {:.2f}us, {} violations\n", phase + 1, PHASES,
+                                  latencies.size(), RSS, getNodeCountOnWorkspace(WS), getStateEntryCount(), P50, P99, VIOLATIONS.size());
+    }
+
+    if (const auto PFULLSCREEN = fullscreenWindow.lock())
+        g_pCompositor->setWindowFullscreenInternal(PFULLSCREEN, FSMODE_NONE);
+
+    // churned workspaces are destroyed again, so anything beyond the starting state only ever grows
+    if (getStateEntryCount() > ENTRIES)
+        failures.push_back(std::format("{} state entries left, started with {}", getStateEntryCount(), ENTRIES));
+
+    if (getNodeCountOnWorkspace(WS) == NODES)
+    {
+        // the saved nodes keep their order and weights, whether a window is hidden is up to date only in the live nodes
+        std::unordered_set<CWindow *> hidden;
+        for (const auto *stack : {LIVE.mainStack, LIVE.secondaryStack})
+        {
+            for (const auto &nd : *stack)
+            {
+                if (nd.hiddenByLayout)
+                    hidden.insert(nd.pWindow.lock().get());
+            }
+        }
+
+        *LIVE.data = SAVEDDATA;
+        *LIVE.mainStack = SAVEDMAIN;
+        *LIVE.secondaryStack = SAVEDSECONDARY;
+        for (auto *stack : {LIVE.mainStack, LIVE.secondaryStack})
+        {
+            for (auto &nd : *stack)
+            {
+                nd.propsApplied = false;
+                nd.hiddenByLayout = hidden.contains(nd.pWindow.lock().get());
+            }
+        }
+        invalidateGeometryCache(WS);
+    }
+    relayoutMonitor(MONITOR);
 
-    if (pWindow->m_workspace != PWINDOW2->m_workspace)
+    if (json)
     {
-        // if different monitors, send to monitor
-        onWindowRemovedTiling(pWindow);
-        pWindow->moveToWorkspace(PWINDOW2->m_workspace);
-        pWindow->m_monitor = PWINDOW2->m_monitor;
-        if (!silent)
+        std::string failureList;
+        for (const auto &failure : failures)
         {
-            const auto pMonitor = pWindow->m_monitor.lock();
-            Desktop::focusState()->rawMonitorFocus(pMonitor);
+            failureList += std::format(R"({}"{}")", failureList.empty() ? "" : ",", failure);
         }
-        onWindowCreatedTiling(pWindow);
+        return std::format(R"({{"workspace": {}, "seed": {}, "passed": {}, "phases": [{}], "failures": [{}]}})", WS, seed, failures.empty(), phases, failureList);
     }
-    else
+
+    std::string result = std::format("soak on workspace {} with seed {}\n{}", WS, seed, phases);
+    for (const auto &failure : failures)
     {
-        // if same monitor, switch windows
-        switchWindows(pWindow, PWINDOW2);
-        if (silent)
-            Desktop::focusState()->fullWindowFocus(PWINDOW2);
+        result += std::format("fail: {}\n", failure);
     }
+    return result + (failures.empty() ? "pass\n" : "");
+}
 
-    pWindow->updateGroupOutputs();
-    if (!pWindow->m_groupData.pNextWindow.expired())
+std::any COrthoLayout::messageCheckInvariants(SLayoutMessageHeader header, CVarList vars)
+{
+    std::vector<WORKSPACEID> workspaces;
+    for (const auto &[ws, _] : m_orthoWorkspaceDataByWorkspace)
     {
-        PHLWINDOW next = pWindow->m_groupData.pNextWindow.lock();
-        while (next != pWindow)
+        workspaces.push_back(ws);
+    }
+
+    int violationCount = 0;
+    for (const auto &ws : workspaces)
+    {
+        for (const auto &violation : checkInvariants(ws))
         {
-            next->updateToplevel();
-            next = next->m_groupData.pNextWindow.lock();
+            Debug::log(ERR, "[ortho] invariant violated on workspace {}: {}", ws, violation);
+            ++violationCount;
         }
     }
+
+    Debug::log(LOG, "[ortho] checked {} workspaces, {} main / {} secondary stacks, {} violations", workspaces.size(), m_mainStackByWorkspace.size(),
+               m_secondaryStackByWorkspace.size(), violationCount);
+    return violationCount;
 }
 
-void COrthoLayout::switchWindows(PHLWINDOW pWindowA, PHLWINDOW pWindowB)
+std::any COrthoLayout::messageDump(SLayoutMessageHeader header, CVarList vars)
 {
-    // windows should be valid, insallah
-    const auto resultA = getNodeFromWindow(pWindowA);
-    const auto resultB = getNodeFromWindow(pWindowB);
+    const bool JSON = vars.size() > 1 && vars[1] == "json";
+    const auto DUMP = getLayoutDump(JSON);
+    // polled by scripts, only worth a log line when tracing
+    Debug::log(TRACE, "[ortho] layout dump:\n{}", DUMP);
+    return DUMP;
+}
 
-    if (!resultA.has_value() || !resultB.has_value())
-        return;
+std::string COrthoLayout::getLayoutDump(bool json)
+{
+    // sorted so consumers can diff consecutive dumps
+    std::vector<WORKSPACEID> workspaces;
+    for (const auto &[ws, _] : m_orthoWorkspaceDataByWorkspace)
+    {
+        workspaces.push_back(ws);
+    }
+    std::ranges::sort(workspaces);
 
-    const auto &[ndA, wsA, statusA] = *resultA;
-    const auto &[ndB, wsB, statusB] = *resultB;
+    static const std::deque<SOrthoNodeData> EMPTYSTACK;
+    const auto stackOf = [](const std::unordered_map<WORKSPACEID, std::deque<SOrthoNodeData>> &stacks, const WORKSPACEID &ws) -> const std::deque<SOrthoNodeData> &
+    {
+        const auto IT = stacks.find(ws);
+        return IT == stacks.end() ? EMPTYSTACK : IT->second;
+    };
 
-    // references to the underlying vectors for modification
-    auto &stackA = (statusA == ORTHOSTATUS_MAIN) ? m_mainStackByWorkspace[wsA] : m_secondaryStackByWorkspace[wsA];
-    auto &stackB = (statusB == ORTHOSTATUS_MAIN) ? m_mainStackByWorkspace[wsB] : m_secondaryStackByWorkspace[wsB];
+    const auto addressOf = [](const SOrthoNodeData &nd) { return rc<uintptr_t>(nd.pWindow.lock().get()); };
 
-    // find indices of the nodes inside their vectors
+    static const SOrthoGeometryCache EMPTYCACHE;
+    const auto cacheOf = [this](const WORKSPACEID &ws) -> const SOrthoGeometryCache &
+    {
+        const auto IT = m_geometryCacheByWorkspace.find(ws);
+        return IT == m_geometryCacheByWorkspace.end() ? EMPTYCACHE : IT->second;
+    };
 
-    const auto NODEITA = std::ranges::find(stackA, *ndA);
-    const auto NODEITB = std::ranges::find(stackB, *ndB);
+    std::string result;
 
-    if (NODEITA == stackA.end() || NODEITB == stackB.end())
-        return;
+    if (json)
+    {
+        const auto formatStack = [&](const std::deque<SOrthoNodeData> &stack)
+        {
+            std::string out;
+            for (const auto &nd : stack)
+            {
+                if (!out.empty())
+                    out += ",";
+                out += std::format(R"({{"address": "0x{:x}", "weight": {}, "collapsed": {}, "at": [{}, {}], "size": [{}, {}]}})", addressOf(nd), nd.weight, nd.collapsed,
+                                   nd.position.x, nd.position.y, nd.size.x, nd.size.y);
+            }
+            return out;
+        };
 
-    const size_t idxA = std::distance(stackA.begin(), NODEITA);
-    const size_t idxB = std::distance(stackB.begin(), NODEITB);
+        for (const auto &ws : workspaces)
+        {
+            const auto &WSDATA = m_orthoWorkspaceDataByWorkspace.at(ws);
 
-    pWindowA->setAnimationsToMove();
-    pWindowB->setAnimationsToMove();
+            std::string overrides;
+            for (const auto &w : WSDATA.mainWeightOverrides)
+            {
+                overrides += std::format("{}{}", overrides.empty() ? "" : ", ", w);
+            }
 
-    // perform swap/move between containers
-    // minimum stack size is invariant across swaps.
-    std::swap(stackA[idxA], stackB[idxB]);
+            if (!result.empty())
+                result += ",";
+            const auto &CACHE = cacheOf(ws);
+            result += std::format(
+                R"({{"workspace": {}, "mainSide": "{}", "percMainStack": {}, "mainStackMin": {}, "overrideMainWeights": {}, "mainWeightOverrides": [{}], "geometryCache": {{"hits": {}, "misses": {}, "skippedCommits": {}}}, "main": [{}], "secondary": [{}]}})",
+                ws, WSDATA.mainSide == MAIN_SIDE_RIGHT ? "right" : "left", WSDATA.percMainStack, WSDATA.mainStackMin, WSDATA.overrideMainWeights, overrides, CACHE.hits,
+                CACHE.misses, CACHE.skippedCommits, formatStack(stackOf(m_mainStackByWorkspace, ws)), formatStack(stackOf(m_secondaryStackByWorkspace, ws)));
+        }
 
-    // recalc/damage
-    recalculateMonitor(pWindowA->monitorID());
-    if (wsA != wsB)
-        recalculateMonitor(pWindowB->monitorID());
+        return "[" + result + "]";
+    }
 
-    g_pHyprRenderer->damageWindow(pWindowA);
-    g_pHyprRenderer->damageWindow(pWindowB);
-}
+    const auto formatStack = [&](const std::deque<SOrthoNodeData> &stack, const char *name)
+    {
+        std::string out;
+        for (size_t i = 0; i < stack.size(); ++i)
+        {
+            const auto &nd = stack[i];
+            out += std::format("\t{} {}: 0x{:x} weight {} at {},{} size {},{}{}\n", name, i, addressOf(nd), nd.weight, nd.position.x, nd.position.y, nd.size.x, nd.size.y,
+                               nd.collapsed ? " (collapsed)" : "");
+        }
+        return out;
+    };
 
-// TODO: allow for dynamic adjustment of the weights
-void COrthoLayout::alterSplitRatio(PHLWINDOW pWindow, float ratio, bool exact) {}
+    for (const auto &ws : workspaces)
+    {
+        const auto &WSDATA = m_orthoWorkspaceDataByWorkspace.at(ws);
 
-// TODO: Consider loops and reverse
-PHLWINDOW COrthoLayout::getNextWindowCandidate(PHLWINDOW pWindow)
-{
+        std::string overrides;
+        for (const auto &w : WSDATA.mainWeightOverrides)
+        {
+            overrides += std::format("{}{}", overrides.empty() ? "" : " ", w);
+        }
 
-    const auto result = getNodeFromWindow(pWindow);
-    if (!result.has_value())
-    {
-        if (!Desktop::focusState()->monitor())
-            return nullptr;
-        const auto ws = Desktop::focusState()->monitor()->activeWorkspaceID();
-        const auto &mainStack = m_mainStackByWorkspace[ws];
-        if (mainStack.empty())
-            return nullptr;
-        return std::ranges::begin(mainStack)->pWindow.lock();
+        const auto &CACHE = cacheOf(ws);
+        result += std::format("workspace {}:\n\tmainSide: {}\n\tpercMainStack: {}\n\tmainStackMin: {}\n\toverrideMainWeights: {}\n\tmainWeightOverrides: {}\n\tgeometryCache: {} hits, {} misses, {} skipped commits\n", ws,
+                              WSDATA.mainSide == MAIN_SIDE_RIGHT ? "right" : "left", WSDATA.percMainStack, WSDATA.mainStackMin, WSDATA.overrideMainWeights, overrides, CACHE.hits,
+                              CACHE.misses, CACHE.skippedCommits);
+        result += formatStack(stackOf(m_mainStackByWorkspace, ws), "main");
+        result += formatStack(stackOf(m_secondaryStackByWorkspace, ws), "secondary");
+        result += "\n";
     }
 
-    const auto &[nd, ws, status] = *result;
+    return result;
+}
 
-    const auto &mainStack = m_mainStackByWorkspace[ws];
-    const auto &secondaryStack = m_secondaryStackByWorkspace[ws];
+std::string COrthoLayout::getPresetFilePath()
+{
+    static auto PPRESETFILE = CConfigValue<Hyprlang::STRING>("plugin:ortho:preset_file");
+
+    const std::string CONFIGURED = *PPRESETFILE;
+    if (!CONFIGURED.empty() && CONFIGURED != STRVAL_EMPTY)
+        return CONFIGURED;
 
-    const auto &firstPool = status == ORTHOSTATUS_MAIN ? mainStack : secondaryStack;
-    const auto &secondPool = status == ORTHOSTATUS_MAIN ? secondaryStack : mainStack;
+    if (const auto STATEHOME = getenv("XDG_STATE_HOME"); STATEHOME && *STATEHOME)
+        return std::string{STATEHOME} + "/hypr/ortho-presets";
+
+    const auto HOME = getenv("HOME");
+    return std::string{HOME ? HOME : ""} + "/.local/state/hypr/ortho-presets";
+}
 
-    const auto NODEIT = std::ranges::find(firstPool, *nd);
-    if (NODEIT == firstPool.end())
+// one preset per line, tab separated:
+// name  percMainStack  side  overrides  main slots  secondary slots
+// overrides are space separated, slots are class=weight joined by ';', '-' marks an empty field
+// percent-encodes the separators of the preset format, and whitespace which the field parser trims
+static std::string escapePresetField(const std::string &field)
+{
+    std::string out;
+    for (const unsigned char c : field)
     {
-        return std::ranges::begin(firstPool)->pWindow.lock();
+        if (c == '%' || c == ';' || c == '=' || std::isspace(c))
+            out += std::format("%{:02X}", c);
+        else
+            out += c;
     }
-    auto CANDIDATE = std::ranges::next(NODEIT);
-    if (CANDIDATE == firstPool.end())
+    return out;
+}
+
+static std::string unescapePresetField(const std::string &field)
+{
+    std::string out;
+    for (size_t i = 0; i < field.size(); ++i)
     {
-        CANDIDATE = std::ranges::begin(secondPool);
-        if (CANDIDATE == secondPool.end())
+        if (field[i] == '%' && i + 2 < field.size() && std::isxdigit(sc<unsigned char>(field[i + 1])) && std::isxdigit(sc<unsigned char>(field[i + 2])))
         {
-            CANDIDATE = std::ranges::begin(firstPool);
+            out += sc<char>(std::stoi(field.substr(i + 1, 2), nullptr, 16));
+            i += 2;
         }
+        else
+            out += field[i];
     }
-    return CANDIDATE->pWindow.lock();
+    return out;
 }
 
-void COrthoLayout::replaceWindowDataWith(PHLWINDOW from, PHLWINDOW to)
+static std::string serializeSlots(const std::vector<SOrthoPresetSlot> &slots)
 {
-    const auto result = getNodeFromWindow(from);
-    if (!result.has_value())
-        return;
-    const auto &[nd, ws, _] = *result;
-    nd->pWindow = to;
-    applyNodeDataToWindow(nd, ws);
+    std::string out;
+    for (const auto &slot : slots)
+    {
+        out += std::format("{}{}={}", out.empty() ? "" : ";", escapePresetField(slot.windowClass), slot.weight);
+    }
+    return out.empty() ? "-" : out;
 }
 
-Vector2D COrthoLayout::predictSizeForNewWindowTiled()
+static std::vector<SOrthoPresetSlot> deserializeSlots(const std::string &field)
 {
-    static auto PMAINSTACKMIN = CConfigValue<Hyprlang::INT>("plugin:ortho:main_stack_min");
-    const int mainStackMinimum = *PMAINSTACKMIN >= 1 ? *PMAINSTACKMIN : 1;
-    if (!Desktop::focusState()->monitor())
-        return {};
-    const auto WS = Desktop::focusState()->monitor()->m_activeWorkspace->m_id;
-    const auto MAINSTACK = m_mainStackByWorkspace[WS];
-    const auto SECONDARYSTACK = m_secondaryStackByWorkspace[WS];
-    const auto WSDATA = m_orthoWorkspaceDataByWorkspace[WS];
-    const auto MSIZE = Desktop::focusState()->monitor()->m_size;
-
-    if (MAINSTACK.size() == 0)
-    { // the workspace is empty as mainStackMin is at least 1
-        return Desktop::focusState()->monitor()->m_size;
-    }
+    std::vector<SOrthoPresetSlot> slots;
+    if (field == "-")
+        return slots;
 
-    if (MAINSTACK.size() < mainStackMinimum)
+    CVarList tokens(field, 0, ';', true);
+    for (const auto &token : tokens)
     {
-        const double HEIGHT = MSIZE.y;
-        double totalWeight = 1; // assume new window has weight 1
-
-        for (auto &nd : MAINSTACK)
+        const auto SEPARATOR = token.rfind('=');
+        if (SEPARATOR == std::string::npos)
+            continue;
+        try
         {
-            totalWeight += nd.weight;
+            const double WEIGHT = std::stod(token.substr(SEPARATOR + 1));
+            if (!std::isfinite(WEIGHT) || WEIGHT <= 0)
+                throw std::invalid_argument("weight is not a positive number");
+            slots.push_back({.windowClass = unescapePresetField(token.substr(0, SEPARATOR)), .weight = WEIGHT});
         }
-
-        const double NPERC = 1 / totalWeight;
-        const double WIDTH = MSIZE.x * WSDATA.percMainStack * NPERC;
-        return Vector2D(WIDTH, HEIGHT);
-    }
-    else
-    {
-        const double WIDTH = MSIZE.x * (1 - WSDATA.percMainStack);
-        double totalWeight = 1;
-
-        for (auto &nd : SECONDARYSTACK)
+        catch (const std::exception &e)
         {
-            totalWeight += nd.weight;
+            Debug::log(ERR, "[ortho] invalid preset slot {}: {}", token, e.what());
         }
-
-        const double NPERC = 1 / totalWeight;
-        double HEIGHT = MSIZE.y * NPERC;
-        return Vector2D(WIDTH, HEIGHT);
     }
+    return slots;
 }
 
-void COrthoLayout::onEnable()
+void COrthoLayout::loadPresets()
 {
-    m_configCallback = g_pHookSystem->hookDynamic("configReloaded", [this](void *hk, SCallbackInfo &info, std::any param) {}); // TODO load orientation and layout overrides
-    for (auto const &w : g_pCompositor->m_windows)
+    m_presetsLoaded = true;
+    m_presets.clear();
+
+    std::ifstream file(getPresetFilePath());
+    if (!file.good())
+        return;
+
+    std::string line;
+    while (std::getline(file, line))
     {
-        if (w->m_isFloating || !w->m_isMapped || w->isHidden())
+        CVarList fields(line, 0, '\t', true);
+        if (fields.size() != 6)
+        {
+            Debug::log(ERR, "[ortho] skipping malformed preset line {}", line);
             continue;
+        }
 
-        onWindowCreatedTiling(w);
+        SOrthoPreset preset;
+        try
+        {
+            const double PERCENT = std::stod(fields[1]);
+            if (!std::isfinite(PERCENT))
+                throw std::invalid_argument("not finite");
+            preset.percMainStack = std::clamp(PERCENT, 0.1, 0.9);
+        }
+        catch (const std::exception &e)
+        {
+            Debug::log(ERR, "[ortho] skipping preset {} with invalid split {}", fields[0], e.what());
+            continue;
+        }
+        preset.mainSide = fields[2] == "right" ? MAIN_SIDE_RIGHT : MAIN_SIDE_LEFT;
+        if (fields[3] != "-")
+        {
+            const auto RESULT = parseOverrideWeights(CVarList(fields[3], 0, ' '));
+            preset.overrideMainWeights = RESULT.has_value();
+            preset.mainWeightOverrides = RESULT.value_or(std::vector<double>{});
+        }
+        preset.mainStack = deserializeSlots(fields[4]);
+        preset.secondaryStack = deserializeSlots(fields[5]);
+        m_presets[unescapePresetField(fields[0])] = preset;
     }
 }
 
-void COrthoLayout::onDisable()
+void COrthoLayout::writePresets()
 {
-    m_mainStackByWorkspace.clear();
-    m_orthoWorkspaceDataByWorkspace.clear();
-    m_secondaryStackByWorkspace.clear();
-}
+    const std::filesystem::path PATH = getPresetFilePath();
 
-bool COrthoLayout::inMain(SOrthoNodeData *nd)
-{
-    for (auto &[ws, nodes] : m_mainStackByWorkspace)
+    std::error_code ec;
+    std::filesystem::create_directories(PATH.parent_path(), ec);
+
+    std::ofstream file(PATH, std::ios::trunc);
+    if (!file.good())
     {
-        const auto IT = std::ranges::find(nodes, *nd);
-        if (IT != nodes.end())
-            return true;
+        Debug::log(ERR, "[ortho] cannot write presets to {}", PATH.string());
+        return;
+    }
+
+    for (const auto &[name, preset] : m_presets)
+    {
+        std::string overrides;
+        if (preset.overrideMainWeights)
+        {
+            for (const auto &w : preset.mainWeightOverrides)
+            {
+                overrides += std::format("{}{}", overrides.empty() ? "" : " ", w);
+            }
+        }
+
+        file << std::format("{}\t{}\t{}\t{}\t{}\t{}\n", escapePresetField(name), preset.percMainStack, preset.mainSide == MAIN_SIDE_RIGHT ? "right" : "left", overrides.empty() ? "-" : overrides,
+                            serializeSlots(preset.mainStack), serializeSlots(preset.secondaryStack));
     }
-    return false;
 }
 
-// TODO: Mostly things to do with setting the main stack factor and weight of active window
-std::any COrthoLayout::layoutMessage(SLayoutMessageHeader header, std::string message)
+std::any COrthoLayout::messageSavePreset(SLayoutMessageHeader header, CVarList vars)
 {
-    auto switchToWindow = [&](PHLWINDOW PWINDOWTOCHANGETO)
+    if (vars.size() != 2 || vars[1].empty())
     {
-        if (!validMapped(PWINDOWTOCHANGETO))
-            return;
+        Debug::log(ERR, "layoutmsg savepreset expects a name");
+        return 0;
+    }
 
-        Desktop::focusState()->fullWindowFocus(PWINDOWTOCHANGETO);
-        g_pCompositor->warpCursorTo(PWINDOWTOCHANGETO->middle());
+    if (!header.pWindow)
+        return 0;
 
-        g_pInputManager->m_forcedFocus = PWINDOWTOCHANGETO;
-        g_pInputManager->simulateMouseMovement();
-        g_pInputManager->m_forcedFocus.reset();
+    if (!m_presetsLoaded)
+        loadPresets();
+
+    const auto WS = header.pWindow->workspaceID();
+    const auto WSDATA = getOrthoWorkspaceData(WS);
+
+    SOrthoPreset preset{
+        .percMainStack = WSDATA->percMainStack,
+        .mainSide = WSDATA->mainSide,
+        .mainWeightOverrides = WSDATA->mainWeightOverrides,
+        .overrideMainWeights = WSDATA->overrideMainWeights,
     };
-    CVarList vars(message, 0, ' ');
 
-    if (vars.size() < 1 || vars[0].empty())
+    const auto captureStack = [](const std::deque<SOrthoNodeData> &stack, std::vector<SOrthoPresetSlot> &slots)
     {
-        Debug::log(ERR, "layoutmsg called without params");
-        return 0;
-    }
+        for (const auto &nd : stack)
+        {
+            const auto PWINDOW = nd.pWindow.lock();
+            slots.push_back({.windowClass = PWINDOW ? PWINDOW->m_class : "", .weight = nd.weight});
+        }
+    };
 
-    auto command = vars[0];
+    captureStack(m_mainStackByWorkspace[WS], preset.mainStack);
+    captureStack(m_secondaryStackByWorkspace[WS], preset.secondaryStack);
 
-    if (command == "adjustweight")
-        return messageAdjustWeight(header, vars);
-    if (command == "overridemainweights")
-        return messageOverrideMainWeights(header, vars);
+    m_presets[vars[1]] = preset;
+    writePresets();
     return 0;
 }
 
-std::any COrthoLayout::messageAdjustWeight(SLayoutMessageHeader header, CVarList vars)
+std::any COrthoLayout::messageLoadPreset(SLayoutMessageHeader header, CVarList vars)
 {
-    const auto PWINDOW = header.pWindow;
-    if (!PWINDOW)
+    if (vars.size() != 2 || vars[1].empty())
+    {
+        Debug::log(ERR, "layoutmsg loadpreset expects a name");
         return 0;
-    const auto RESULT = getNodeFromWindow(PWINDOW);
-    if (!RESULT.has_value())
+    }
+
+    if (!header.pWindow)
         return 0;
-    auto &[nd, _, __] = *RESULT;
 
-    if (vars.size() == 0)
+    if (!m_presetsLoaded)
+        loadPresets();
+
+    const auto PRESET = m_presets.find(vars[1]);
+    if (PRESET == m_presets.end())
     {
-        Debug::log(ERR, "layoutmsg adjustweight called without params");
+        Debug::log(ERR, "layoutmsg loadpreset: no preset named {}", vars[1]);
+        return 0;
     }
 
-    if (vars.size() == 2)
+    const auto WS = header.pWindow->workspaceID();
+    auto &MAINSTACK = m_mainStackByWorkspace[WS];
+    auto &SECONDARYSTACK = m_secondaryStackByWorkspace[WS];
+
+    std::vector<SOrthoNodeData> pool(MAINSTACK.begin(), MAINSTACK.end());
+    pool.insert(pool.end(), SECONDARYSTACK.begin(), SECONDARYSTACK.end());
+    std::vector<bool> used(pool.size(), false);
+
+    // slots are first matched by window class, whatever is left fills the remaining slots in order
+    const std::array SLOTS = {&PRESET->second.mainStack, &PRESET->second.secondaryStack};
+    std::vector<std::vector<std::optional<size_t>>> assignment;
+    for (const auto *slots : SLOTS)
     {
-        try
-        {
-            float adjustment = std::stof(vars[1]);
-            nd->weight += adjustment;
-            recalculateMonitor(header.pWindow->monitorID());
-        }
-        catch (const std::invalid_argument &e)
-        {
-            Debug::log(ERR, "layoutmsg adjustweight called without number {}", e.what());
-            return 0;
-        }
-        catch (const std::out_of_range &e)
+        auto &assigned = assignment.emplace_back(slots->size());
+        for (size_t i = 0; i < slots->size(); ++i)
         {
-            Debug::log(ERR, "layoutmsg adjustweight called without outofrange {}", e.what());
-            return 0;
+            for (size_t j = 0; j < pool.size(); ++j)
+            {
+                const auto PWINDOW = pool[j].pWindow.lock();
+                if (!used[j] && PWINDOW && PWINDOW->m_class == (*slots)[i].windowClass)
+                {
+                    assigned[i] = j;
+                    used[j] = true;
+                    break;
+                }
+            }
         }
     }
-    else if (vars.size() == 3)
+
+    size_t nextUnused = 0;
+    for (auto &assigned : assignment)
     {
-        if (vars[1] != "exact")
-        {
-            Debug::log(ERR, "layoutmsg called with invalid specifier");
-            return 0;
-        }
-        try
+        for (auto &slot : assigned)
         {
-            float newWeight = std::stof(vars[2]);
-            nd->weight = newWeight;
-            recalculateMonitor(header.pWindow->monitorID());
-        }
-        catch (const std::invalid_argument &e)
-        {
-            Debug::log(ERR, "layoutmsg adjustweight called without number {}", e.what());
-            return 0;
+            while (!slot.has_value() && nextUnused < pool.size())
+            {
+                if (!used[nextUnused])
+                {
+                    slot = nextUnused;
+                    used[nextUnused] = true;
+                }
+                ++nextUnused;
+            }
         }
-        catch (const std::out_of_range &e)
+    }
+
+    // build both stacks in one go, nothing is committed until the single relayout below
+    std::deque<SOrthoNodeData> newStacks[2];
+    size_t stackIdx = 0;
+    for (const auto *slots : SLOTS)
+    {
+        for (size_t i = 0; i < slots->size(); ++i)
         {
-            Debug::log(ERR, "layoutmsg adjustweight called without outofrange {}", e.what());
-            return 0;
+            if (!assignment[stackIdx][i].has_value())
+                continue;
+            auto node = pool[*assignment[stackIdx][i]];
+            node.weight = (*slots)[i].weight;
+            newStacks[stackIdx].push_back(node);
         }
+        ++stackIdx;
     }
-    else
+
+    // windows the preset has no slot for go on top of the secondary stack
+    for (size_t j = 0; j < pool.size(); ++j)
     {
-        Debug::log(ERR, "layoutmsg adjustweight called with too many params");
+        if (!used[j])
+            newStacks[1].push_back(pool[j]);
     }
-    return 0;
-}
 
-std::any COrthoLayout::messageOverrideMainWeights(SLayoutMessageHeader header, CVarList vars)
-{
-    if (vars.size() == 1)
+    // a preset saved with fewer main slots than the workspace's minimum still leaves main at its minimum
+    const auto WSDATA = getOrthoWorkspaceData(WS);
+    while (newStacks[0].size() < sc<size_t>(WSDATA->mainStackMin) && !newStacks[1].empty())
     {
-        Debug::log(ERR, "layoutmsg overridemainweights called without params");
+        newStacks[0].push_back(newStacks[1].back());
+        newStacks[1].pop_back();
     }
 
-    const auto WS = header.pWindow->m_workspace->m_id;
-    const auto MAINSIZE = m_mainStackByWorkspace[WS].size();
-    auto WSDATA = getOrthoWorkspaceData(WS);
+    MAINSTACK = std::move(newStacks[0]);
+    SECONDARYSTACK = std::move(newStacks[1]);
 
-    const auto RESULT = parseOverrideWeights(vars, size_t(1), vars.size());
-    if (RESULT.has_value())
-    {
-        WSDATA->overrideMainWeights = true;
-        WSDATA->mainWeightOverrides = *RESULT;
-    }
+    WSDATA->percMainStack = PRESET->second.percMainStack;
+    WSDATA->mainSide = PRESET->second.mainSide;
+    WSDATA->mainWeightOverrides = PRESET->second.mainWeightOverrides;
+    WSDATA->overrideMainWeights = PRESET->second.overrideMainWeights;
+    WSDATA->percMainStackSetAtRuntime = true;
+    WSDATA->mainSideSetAtRuntime = true;
+    WSDATA->mainWeightsSetAtRuntime = true;
 
-    recalculateMonitor(header.pWindow->monitorID());
+    markLayoutChanged(WS);
+    recalculateWorkspaceOrDefer(WS, header.pWindow->monitorID());
     return 0;
 }
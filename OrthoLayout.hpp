@@ -1,14 +1,24 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <deque>
 #include <vector>
 #include <list>
+#include <map>
+#include <optional>
+#include <regex>
+#include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <any>
 #include <hyprland/src/layout/IHyprLayout.hpp>
 #include <hyprland/src/helpers/memory/Memory.hpp>
 #include <hyprland/src/managers/HookSystemManager.hpp>
+#include <hyprland/src/managers/eventLoop/EventLoopTimer.hpp>
 #include <hyprland/src/desktop/DesktopTypes.hpp>
 #include <hyprutils/string/ConstVarList.hpp>
+#include "OrthoShm.h"
 
 enum eFullscreenMode : int8_t;
 
@@ -25,6 +35,23 @@ enum eOrthoStatus
     ORTHOSTATUS_SECONDARY,
 };
 
+enum eOrthoInsertPosition : uint8_t
+{
+    ORTHOINSERT_TOP = 0,
+    ORTHOINSERT_BOTTOM,
+    ORTHOINSERT_AFTER_FOCUSED,
+};
+
+// initial placement for windows matching class and title, from plugin:ortho:placement
+struct SOrthoPlacementRule
+{
+    std::optional<std::regex> windowClass;
+    std::optional<std::regex> title;
+    std::optional<eOrthoStatus> stack;
+    eOrthoInsertPosition position = ORTHOINSERT_TOP;
+    double weight = 1;
+};
+
 struct SOrthoNodeData
 {
     // many traits inferred from membership
@@ -35,6 +62,18 @@ struct SOrthoNodeData
 
     bool ignoreFullscreenChecks = false;
 
+    // grid cell within a wrapped secondary stack, counted from the main stack and from the bottom
+    size_t column = 0;
+    size_t row = 0;
+
+    // parked below the visible part of a collapsed secondary stack
+    bool collapsed = false;
+    // whether the layout currently hides the window, lags collapsed until the next commit
+    bool hiddenByLayout = false;
+
+    // layout priority props were reset and the window data refreshed for this node
+    bool propsApplied = false;
+
     bool operator==(const SOrthoNodeData &rhs) const
     {
         return pWindow.lock() == rhs.pWindow.lock();
@@ -48,15 +87,160 @@ struct SOrthoWorkspaceData
     double percMainStack = 0.5;
     int mainStackMin = 1;
     WORKSPACEID workspaceID = WORKSPACE_INVALID;
+    // monitor the settings were resolved for
+    MONITORID monitorID = MONITOR_INVALID;
     eMainSide mainSide = MAIN_SIDE_LEFT;
     std::vector<double> mainWeightOverrides;
     bool overrideMainWeights = false;
+    // set through layoutmsg, rules no longer touch these fields for the lifetime of the workspace
+    bool percMainStackSetAtRuntime = false;
+    bool mainSideSetAtRuntime = false;
+    bool mainWeightsSetAtRuntime = false;
+    // tiled count and fullscreen state the window data of the nodes was refreshed for,
+    // workspace rule selectors such as w[tv1] or f[1] match on both
+    int propsTiledCount = -1;
+    bool propsFullscreen = false;
+    // copies the configurable fields the user has not changed at runtime, leaves the workspace id alone
+    void applySettings(const SOrthoWorkspaceData &settings);
     bool operator==(const SOrthoWorkspaceData &rhs) const
     {
         return workspaceID == rhs.workspaceID;
     }
 };
 
+// which stacks of a workspace skip their animation for the current pass
+struct SOrthoWarpDecision
+{
+    bool warpMain = false;
+    bool warpSecondary = false;
+};
+
+// last payloads posted on the event socket, used to drop duplicates
+struct SOrthoEmittedEvents
+{
+    std::string stack;
+    std::string weights;
+};
+
+// partial settings from a monitor rule or a workspace rule's layoutopts
+struct SOrthoSettingsOverride
+{
+    std::optional<double> percMainStack;
+    std::optional<int> mainStackMin;
+    std::optional<eMainSide> mainSide;
+    std::optional<std::vector<double>> mainWeightOverrides;
+
+    void applyTo(SOrthoWorkspaceData &) const;
+};
+
+// one node of a saved preset, matched back to windows by class on restore
+struct SOrthoPresetSlot
+{
+    std::string windowClass;
+    double weight = 1;
+};
+
+struct SOrthoPreset
+{
+    double percMainStack = 0.5;
+    eMainSide mainSide = MAIN_SIDE_LEFT;
+    std::vector<double> mainWeightOverrides;
+    bool overrideMainWeights = false;
+    std::vector<SOrthoPresetSlot> mainStack;
+    std::vector<SOrthoPresetSlot> secondaryStack;
+};
+
+// slot of a tiled window that was made floating, so tiling it again puts it back in place
+struct SOrthoTombstone
+{
+    PHLWINDOWREF pWindow;
+    WORKSPACEID ws = WORKSPACE_INVALID;
+    eOrthoStatus status = ORTHOSTATUS_SECONDARY;
+    // counted from the bottom of the stack
+    size_t index = 0;
+    double weight = 1;
+    // secondary node that filled the emptied main stack, handed back on return
+    PHLWINDOWREF promoted;
+};
+
+// everything computeWorkspaceGeometry reads, plus the gaps the commit adds on top
+struct SOrthoGeometryKey
+{
+    Vector2D monitorPosition;
+    Vector2D monitorSize;
+    Vector2D reservedTopLeft;
+    Vector2D reservedBottomRight;
+    double scale = 1;
+    std::array<int64_t, 8> gaps = {};
+    double percMainStack = 0.5;
+    eMainSide mainSide = MAIN_SIDE_LEFT;
+    bool overrideMainWeights = false;
+    std::vector<double> mainWeightOverrides;
+    // node counts are implied by the weight vectors
+    std::vector<double> mainWeights;
+    std::vector<double> secondaryWeights;
+    int64_t secondaryVisible = 0;
+    int64_t minRowHeight = 0;
+
+    bool operator==(const SOrthoGeometryKey &) const = default;
+};
+
+struct SOrthoCachedBox
+{
+    Vector2D position;
+    Vector2D size;
+    size_t column = 0;
+    size_t row = 0;
+    bool collapsed = false;
+};
+
+// last computed geometry of a workspace, reused while its key stays the same
+struct SOrthoGeometryCache
+{
+    std::optional<SOrthoGeometryKey> key;
+    // main stack first, then secondary
+    std::vector<SOrthoCachedBox> boxes;
+    // window goals once the last commit finished, only meaningful while committed is set
+    bool committed = false;
+    std::vector<std::pair<PHLWINDOWREF, CBox>> committedGoals;
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t skippedCommits = 0;
+};
+
+// a node whose box still has to be applied to its window
+struct SOrthoPendingCommit
+{
+    PHLWINDOWREF pWindow;
+    bool warp = false;
+};
+
+// remainder of a commit that ran out of its time budget
+struct SOrthoPendingWorkspaceCommit
+{
+    std::vector<SOrthoPendingCommit> commits;
+    size_t next = 0;
+    size_t minPerSlice = 0;
+    std::chrono::duration<float, std::milli> budget{0};
+    // refresh interval of the workspace's monitor, the next slice waits this long
+    std::chrono::duration<float, std::milli> frameInterval{0};
+};
+
+// one workspace's layout state, either the live maps or a private copy for simulation
+struct SOrthoWorkspaceState
+{
+    SOrthoWorkspaceData *data = nullptr;
+    std::deque<SOrthoNodeData> *mainStack = nullptr;
+    std::deque<SOrthoNodeData> *secondaryStack = nullptr;
+
+    SOrthoNodeData *findNode(PHLWINDOW pWindow, eOrthoStatus *status = nullptr) const;
+    // false for a workspace the layout holds no state for
+    bool valid() const
+    {
+        return data && mainStack && secondaryStack;
+    }
+};
+
 struct SNodeLookupResult
 {
     SOrthoNodeData *nd;
@@ -83,6 +267,8 @@ public:
     virtual void replaceWindowDataWith(PHLWINDOW from, PHLWINDOW to);
     virtual Vector2D predictSizeForNewWindowTiled();
     virtual PHLWINDOW getNextWindowCandidate(PHLWINDOW pWindow);
+    virtual void changeWindowFloatingMode(PHLWINDOW);
+    virtual void onWindowRemovedFloating(PHLWINDOW);
 
     virtual void onEnable();
     virtual void onDisable();
@@ -90,26 +276,157 @@ public:
     // Returns whether the given window is marked as master in this layout.
     bool isWindowInMainStack(PHLWINDOW pWindow);
 
+    // Serializes stacks, weights and boxes of every workspace, for hyprctl and layoutmsg.
+    std::string getLayoutDump(bool json);
+
+    // Config keyword plugin:ortho:monitor, returns an error on failure.
+    std::optional<std::string> addMonitorRule(const std::string &rule);
+    // Config keyword plugin:ortho:placement, returns an error on failure.
+    std::optional<std::string> addPlacementRule(const std::string &rule);
+    void clearConfigRules();
+
+    // Applies a state command to a copy of the window's workspace and returns the resulting boxes, for hyprctl and layoutmsg.
+    std::string simulate(PHLWINDOW pWindow, const std::string &command, bool json);
+
+    // Drives randomized operations through the window's workspace and reports memory, latency and invariant drift, for hyprctl.
+    std::string soak(PHLWINDOW pWindow, const std::string &args, bool json);
+
 private:
     std::unordered_map<WORKSPACEID, SOrthoWorkspaceData> m_orthoWorkspaceDataByWorkspace;
-    std::unordered_map<WORKSPACEID, std::vector<SOrthoNodeData>> m_mainStackByWorkspace;
-    std::unordered_map<WORKSPACEID, std::vector<SOrthoNodeData>> m_secondaryStackByWorkspace;
+    std::unordered_map<WORKSPACEID, std::deque<SOrthoNodeData>> m_mainStackByWorkspace;
+    std::unordered_map<WORKSPACEID, std::deque<SOrthoNodeData>> m_secondaryStackByWorkspace;
+
+    // config compiled at load, resolved settings are cached per workspace and monitor
+    bool m_settingsCompiled = false;
+    SOrthoWorkspaceData m_defaultWorkspaceData;
+    std::unordered_map<std::string, SOrthoSettingsOverride> m_monitorRules;
+    // keyed on the monitor as well, so a workspace moving back and forth does not walk the rules each time
+    std::map<std::pair<WORKSPACEID, MONITORID>, SOrthoWorkspaceData> m_resolvedSettingsByWorkspace;
+    std::vector<SOrthoPlacementRule> m_placementRules;
 
     SP<HOOK_CALLBACK_FN> m_configCallback;
+    SP<HOOK_CALLBACK_FN> m_renderCallback;
+    SP<HOOK_CALLBACK_FN> m_workspaceDestroyedCallback;
+    SP<HOOK_CALLBACK_FN> m_activeWindowCallback;
+    SP<HOOK_CALLBACK_FN> m_workspaceCallback;
+    SP<HOOK_CALLBACK_FN> m_moveWindowCallback;
+    std::vector<SP<HOOK_CALLBACK_FN>> m_topologyCallbacks;
+
+    // monitor hotplug: relayouts are held back until no monitor changed for a while
+    SP<CEventLoopTimer> m_topologyTimer;
+    bool m_topologySettling = false;
+    bool m_warpAll = false;
+
+    // named layouts, read from the preset file on first use
+    bool m_presetsLoaded = false;
+    std::unordered_map<std::string, SOrthoPreset> m_presets;
+
+    // slots of floated windows, only valid while a floating toggle is in progress or the window floats
+    std::vector<SOrthoTombstone> m_tombstones;
+    bool m_floatToggle = false;
+
+    // hidden workspaces with structural changes, laid out once they are shown
+    std::unordered_set<WORKSPACEID> m_dirtyWorkspaces;
+
+    // deferred work runs once per burst, the token keeps it from outliving the layout
+    SP<bool> m_lifetimeToken = makeShared<bool>(true);
+    bool m_postPassFlushScheduled = false;
+    std::unordered_set<WORKSPACEID> m_pendingEventWorkspaces;
+    std::unordered_map<WORKSPACEID, SOrthoEmittedEvents> m_lastEmittedEvents;
+    std::unordered_set<WORKSPACEID> m_pendingWindowUpdates;
+    bool m_x11WorkAreaDirty = false;
+    std::optional<CBox> m_lastX11WorkArea;
+
+    // time sliced commits, continued one refresh interval later so a frame goes out in between
+    std::unordered_map<WORKSPACEID, SOrthoPendingWorkspaceCommit> m_pendingCommitsByWorkspace;
+    SP<CEventLoopTimer> m_commitTimer;
+    bool m_commitContinuationScheduled = false;
+
+    std::unordered_map<WORKSPACEID, SOrthoGeometryCache> m_geometryCacheByWorkspace;
+
+    // shared memory table for local overlays, rewritten from the post pass flush after commits finish
+    SOrthoShmTable *m_shmTable = nullptr;
+    std::string m_shmName;
+    bool m_shmDirty = false;
+
+    // nodes that moved while their workspace was covered by a fullscreen window
+    std::unordered_map<WORKSPACEID, std::unordered_set<CWindow *>> m_frozenMovedWindows;
+    std::unordered_set<WORKSPACEID> m_fullscreenExitCommitted;
+    std::chrono::steady_clock::time_point m_frameStart;
+    float m_lastFrameTimeMs = 0.F;
     bool m_forceWarps = false;
     bool inMain(SOrthoNodeData *);
-    void applyNodeDataToWindow(SOrthoNodeData *, const WORKSPACEID &ws);
+    void applyNodeDataToWindow(SOrthoNodeData *, const WORKSPACEID &ws, bool warp = false);
+    // gaps, reserved area and size limits around a node box, snapped to the monitor's pixel grid
+    CBox getWindowBoxForNode(const SOrthoNodeData &, PHLMONITOR, PHLWINDOW);
+    SOrthoWarpDecision getWarpPolicy(const WORKSPACEID &ws, int movedNodes);
     std::optional<SNodeLookupResult> getNodeFromWindow(PHLWINDOW pWindow);
     int getNodeCountOnWorkspace(const WORKSPACEID &ws);
     int getSecondaryStackSize(const WORKSPACEID &ws);
     int getMainStackSize(const WORKSPACEID &ws);
     SOrthoNodeData *getOrthoNodeOnWorkspace(const WORKSPACEID &);
     SOrthoWorkspaceData *getOrthoWorkspaceData(const WORKSPACEID &);
+    void compileSettings();
+    const SOrthoWorkspaceData &resolveSettings(const WORKSPACEID &, PHLMONITOR);
+    void onConfigReloaded();
+    const SOrthoPlacementRule *getPlacementRuleFor(PHLWINDOW);
     void calculateWorkspace(PHLWORKSPACE);
+    void recalculateWorkspaceOrDefer(const WORKSPACEID &, const MONITORID &);
+    void commitWorkspace(const WORKSPACEID &, PHLMONITOR, std::vector<SOrthoPendingCommit> &&);
+    SOrthoGeometryKey getGeometryKey(PHLWORKSPACE, PHLMONITOR, SOrthoWorkspaceData *);
+    void invalidateGeometryCache(const WORKSPACEID &);
+    // records the window goals once a commit has been applied completely
+    void onCommitFinished(const WORKSPACEID &);
+    // whether every window still sits at the goal of the last finished commit
+    bool isCommitCurrent(const WORKSPACEID &, const SOrthoGeometryCache &);
+    // applies what changed while fullscreen was active, in one pass
+    void commitFrozenWorkspace(const WORKSPACEID &, PHLWINDOW pFullscreenWindow);
+    // applies pending nodes until the budget runs out, returns whether any are left
+    bool commitSlice(const WORKSPACEID &, SOrthoPendingWorkspaceCommit &);
+    void scheduleCommitContinuation();
+    void continueCommits();
+    // recalculateMonitor without the hold during monitor hotplug, for layout changes of our own
+    void relayoutMonitor(const MONITORID &);
+    void onTopologyChanged();
+    void onTopologySettled();
+    // fills in node boxes for both stacks without touching any window
+    void computeWorkspaceGeometry(PHLMONITOR, SOrthoWorkspaceData *, std::deque<SOrthoNodeData> &mainStack, std::deque<SOrthoNodeData> &secondaryStack);
     SOrthoNodeData *getMainStackTop(const WORKSPACEID &ws);
     SOrthoNodeData *getSecondaryStackTop(const WORKSPACEID &ws);
-    std::any messageAdjustWeight(SLayoutMessageHeader, CVarList);
-    std::any messageOverrideMainWeights(SLayoutMessageHeader, CVarList);
+    SOrthoWorkspaceState getWorkspaceState(const WORKSPACEID &ws);
+    // mutates only the given state, returns whether the layout has to be recomputed
+    bool applyStateMessage(const SOrthoWorkspaceState &, PHLWINDOW, const CVarList &);
+    std::any messageStateChange(SLayoutMessageHeader, CVarList);
+    std::any messageSimulate(SLayoutMessageHeader, CVarList);
+    std::any messageCheckInvariants(SLayoutMessageHeader, CVarList);
+    std::any messageDump(SLayoutMessageHeader, CVarList);
+    std::any messageSavePreset(SLayoutMessageHeader, CVarList);
+    std::any messageLoadPreset(SLayoutMessageHeader, CVarList);
+    std::string getPresetFilePath();
+    void loadPresets();
+    void writePresets();
+    void setNodeHidden(SOrthoNodeData &, bool hidden);
+    // marks every node for a window data refresh once the workspace's rule selectors may match differently
+    void invalidateNodePropsOnSelectorChange(PHLWORKSPACE);
+    // puts a floated window back into its old slot, returns false if it has none left
+    bool restoreFromTombstone(PHLWINDOW);
+    // forgets the slot of a floated window that will not return to it, refilling main if needed
+    void dropTombstone(PHLWINDOW);
+    void bringNodeForward(PHLWINDOW);
+    void onWorkspaceDestroyed(const WORKSPACEID &ws);
+    void markLayoutChanged(const WORKSPACEID &ws);
+    void schedulePostPassFlush();
+    void flushPostPass();
+    void emitLayoutEvents(const WORKSPACEID &ws);
+    void updateX11WorkArea();
+    bool openShmExport();
+    void closeShmExport();
+    void publishShm();
+    // structural checks for long running sessions, returns a description per violation
+    std::vector<std::string> checkInvariants(const WORKSPACEID &ws);
+    // entries in every per-workspace map, for spotting state that outlives its workspace
+    size_t getStateEntryCount();
+    void debugCheckInvariants(const WORKSPACEID &ws);
 
     friend struct SOrthoNodeData;
     friend struct SOrthoWorkspaceData;
@@ -0,0 +1,89 @@
+#pragma once
+
+// Live ortho geometry, published into the shared memory object /hyprortho-<HYPRLAND_INSTANCE_SIGNATURE>
+// when plugin:ortho:shm_export is set. The table has a fixed size and layout and is rewritten after
+// every finished commit. It is guarded by a seqlock: sequence is odd while the writer is inside,
+// so readers copy the table and retry if sequence was odd or changed, see orthoShmRead.
+// Plain C so overlays in any language with a C FFI can use it.
+
+#include <stdint.h>
+#include <string.h>
+
+#define ORTHO_SHM_MAGIC          0x4f52544fu // "ORTO"
+#define ORTHO_SHM_VERSION        1u
+#define ORTHO_SHM_NAME_PREFIX    "/hyprortho-"
+#define ORTHO_SHM_MAX_WORKSPACES 64u
+#define ORTHO_SHM_MAX_NODES      512u
+
+// the table did not fit and lists only the first workspaces and nodes
+#define ORTHO_SHM_FLAG_TRUNCATED 1u
+
+enum eOrthoShmStack
+{
+    ORTHO_SHM_STACK_MAIN = 0,
+    ORTHO_SHM_STACK_SECONDARY = 1,
+};
+
+typedef struct SOrthoShmNode
+{
+    // window address, the same as in hyprctl clients
+    uint64_t window;
+    // committed window box in logical layout coordinates
+    double   x, y, w, h;
+    double   weight;
+    // position in its stack, counted from the bottom
+    uint32_t index;
+    uint8_t  stack;
+    uint8_t  collapsed;
+    uint8_t  pad[2];
+} SOrthoShmNode;
+
+typedef struct SOrthoShmWorkspace
+{
+    int64_t  id;
+    double   percMainStack;
+    // nodes[firstNode] up to nodes[firstNode + mainCount + secondaryCount], main stack first
+    uint32_t firstNode;
+    uint32_t mainCount;
+    uint32_t secondaryCount;
+    // 0 left, 1 right
+    uint8_t  mainSide;
+    uint8_t  pad[3];
+} SOrthoShmWorkspace;
+
+typedef struct SOrthoShmTable
+{
+    uint32_t           magic;
+    uint32_t           version;
+    // odd while the writer is inside the table
+    uint64_t           sequence;
+    uint32_t           size;
+    uint32_t           flags;
+    uint32_t           workspaceCount;
+    uint32_t           nodeCount;
+    SOrthoShmWorkspace workspaces[ORTHO_SHM_MAX_WORKSPACES];
+    SOrthoShmNode      nodes[ORTHO_SHM_MAX_NODES];
+} SOrthoShmTable;
+
+// copies a consistent snapshot of shared into out, returns 0 on success and -1 on a foreign or
+// incompatible table. gives up after maxRetries torn reads and returns 1.
+static inline int orthoShmRead(const SOrthoShmTable *shared, SOrthoShmTable *out, unsigned maxRetries)
+{
+    if (__atomic_load_n(&shared->magic, __ATOMIC_ACQUIRE) != ORTHO_SHM_MAGIC || shared->version != ORTHO_SHM_VERSION || shared->size != sizeof(SOrthoShmTable))
+        return -1;
+
+    for (unsigned i = 0; i <= maxRetries; ++i)
+    {
+        const uint64_t BEFORE = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+        if (BEFORE & 1)
+            continue;
+
+        memcpy(out, shared, sizeof(SOrthoShmTable));
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shared->sequence, __ATOMIC_RELAXED) == BEFORE)
+            return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,93 @@
+// Prints the ortho geometry published with plugin:ortho:shm_export = 1, once or every interval.
+//
+//   cc -I.. orthoshm-reader.c -o orthoshm-reader
+//   ./orthoshm-reader [interval_ms]
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "OrthoShm.h"
+
+static void printTable(const SOrthoShmTable *table)
+{
+    printf("sequence %llu, %u workspaces, %u nodes%s\n", (unsigned long long)table->sequence, table->workspaceCount, table->nodeCount,
+           table->flags & ORTHO_SHM_FLAG_TRUNCATED ? " (truncated)" : "");
+
+    for (uint32_t i = 0; i < table->workspaceCount; ++i)
+    {
+        const SOrthoShmWorkspace *ws = &table->workspaces[i];
+        printf("workspace %lld: main %s, %.2f\n", (long long)ws->id, ws->mainSide ? "right" : "left", ws->percMainStack);
+
+        for (uint32_t n = ws->firstNode; n < ws->firstNode + ws->mainCount + ws->secondaryCount; ++n)
+        {
+            const SOrthoShmNode *nd = &table->nodes[n];
+            printf("\t%s %u: 0x%llx weight %.2f at %.0f,%.0f size %.0fx%.0f%s\n", nd->stack == ORTHO_SHM_STACK_MAIN ? "main" : "secondary", nd->index,
+                   (unsigned long long)nd->window, nd->weight, nd->x, nd->y, nd->w, nd->h, nd->collapsed ? " (collapsed)" : "");
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *signature = getenv("HYPRLAND_INSTANCE_SIGNATURE");
+    if (!signature)
+    {
+        fprintf(stderr, "HYPRLAND_INSTANCE_SIGNATURE is not set\n");
+        return 1;
+    }
+
+    char name[256];
+    snprintf(name, sizeof(name), "%s%s", ORTHO_SHM_NAME_PREFIX, signature);
+
+    const int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        perror("shm_open, is plugin:ortho:shm_export enabled?");
+        return 1;
+    }
+
+    const SOrthoShmTable *shared = mmap(NULL, sizeof(SOrthoShmTable), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+
+    const long intervalMs = argc > 1 ? atol(argv[1]) : 0;
+    // the snapshot is large, keep it off the stack
+    static SOrthoShmTable snapshot;
+    uint64_t lastSequence = UINT64_MAX;
+
+    for (;;)
+    {
+        // polling the sequence is a plain memory read, only copy when the writer published something new
+        if (__atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE) != lastSequence)
+        {
+            const int result = orthoShmRead(shared, &snapshot, 64);
+            if (result < 0)
+            {
+                fprintf(stderr, "table is missing or has an incompatible version\n");
+                return 1;
+            }
+            if (result == 0)
+            {
+                lastSequence = snapshot.sequence;
+                printTable(&snapshot);
+            }
+        }
+
+        if (intervalMs <= 0)
+            break;
+
+        const struct timespec delay = {intervalMs / 1000, (intervalMs % 1000) * 1000000};
+        nanosleep(&delay, NULL);
+    }
+
+    munmap((void *)shared, sizeof(SOrthoShmTable));
+    return 0;
+}
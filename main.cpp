@@ -11,6 +11,8 @@
 #include <hyprland/src/config/ConfigManager.hpp>
 #include <hyprland/src/render/Renderer.hpp>
 #include <hyprland/src/managers/KeybindManager.hpp>
+#include <hyprland/src/debug/HyprCtl.hpp>
+#include <hyprland/src/desktop/state/FocusState.hpp>
 #undef private
 
 #include <hyprutils/string/VarList.hpp>
@@ -26,6 +28,26 @@ APICALL EXPORT std::string PLUGIN_API_VERSION()
 }
 
 UP<COrthoLayout> g_pOrthoLayout;
+SP<SHyprCtlCommand> g_pDumpCommand;
+SP<SHyprCtlCommand> g_pSimulateCommand;
+SP<SHyprCtlCommand> g_pSoakCommand;
+SP<HOOK_CALLBACK_FN> g_pPreConfigReloadCallback;
+
+static Hyprlang::CParseResult onMonitorKeyword(const char *COMMAND, const char *VALUE)
+{
+    Hyprlang::CParseResult result;
+    if (const auto ERROR = g_pOrthoLayout->addMonitorRule(VALUE); ERROR.has_value())
+        result.setError(ERROR->c_str());
+    return result;
+}
+
+static Hyprlang::CParseResult onPlacementKeyword(const char *COMMAND, const char *VALUE)
+{
+    Hyprlang::CParseResult result;
+    if (const auto ERROR = g_pOrthoLayout->addPlacementRule(VALUE); ERROR.has_value())
+        result.setError(ERROR->c_str());
+    return result;
+}
 
 //
 
@@ -50,8 +72,61 @@ APICALL EXPORT PLUGIN_DESCRIPTION_INFO PLUGIN_INIT(HANDLE handle)
     HyprlandAPI::addConfigValue(PHANDLE, "plugin:ortho:main_stack_min", Hyprlang::INT{1});
     HyprlandAPI::addConfigValue(PHANDLE, "plugin:ortho:main_stack_side", Hyprlang::STRING{"left"});
     HyprlandAPI::addConfigValue(PHANDLE, "plugin:ortho:main_weight_overrides", Hyprlang::STRING{""});
+    HyprlandAPI::addConfigValue(PHANDLE, "plugin:ortho:warp_threshold", Hyprlang::INT{0});
+    HyprlandAPI::addConfigValue(PHANDLE, "plugin:ortho:frame_budget_ms", Hyprlang::FLOAT{0.F});
+    HyprlandAPI::addConfigValue(PHANDLE, "plugin:ortho:warp_policy", Hyprlang::STRING{"all"});
+    HyprlandAPI::addConfigValue(PHANDLE, "plugin:ortho:debug_invariants", Hyprlang::INT{0});
+    HyprlandAPI::addConfigValue(PHANDLE, "plugin:ortho:secondary_min_row_height", Hyprlang::INT{0});
+    HyprlandAPI::addConfigValue(PHANDLE, "plugin:ortho:secondary_visible", Hyprlang::INT{0});
+    HyprlandAPI::addConfigValue(PHANDLE, "plugin:ortho:preset_file", Hyprlang::STRING{""});
+    HyprlandAPI::addConfigValue(PHANDLE, "plugin:ortho:hotplug_settle_ms", Hyprlang::INT{250});
+    HyprlandAPI::addConfigValue(PHANDLE, "plugin:ortho:hotplug_snap", Hyprlang::INT{0});
+    HyprlandAPI::addConfigValue(PHANDLE, "plugin:ortho:commit_budget", Hyprlang::FLOAT{0.F});
+    HyprlandAPI::addConfigValue(PHANDLE, "plugin:ortho:commit_max_frames", Hyprlang::INT{4});
+    HyprlandAPI::addConfigValue(PHANDLE, "plugin:ortho:shm_export", Hyprlang::INT{0});
+    HyprlandAPI::addConfigKeyword(PHANDLE, "plugin:ortho:monitor", onMonitorKeyword, Hyprlang::SHandlerOptions{});
+    HyprlandAPI::addConfigKeyword(PHANDLE, "plugin:ortho:placement", onPlacementKeyword, Hyprlang::SHandlerOptions{});
+    // keyword rules are re-added on every parse
+    g_pPreConfigReloadCallback = HyprlandAPI::registerCallbackDynamic(PHANDLE, "preConfigReload", [](void *self, SCallbackInfo &info, std::any data)
+                                                                      { g_pOrthoLayout->clearConfigRules(); });
     HyprlandAPI::addLayout(PHANDLE, "ortho", g_pOrthoLayout.get());
 
+    g_pDumpCommand = HyprlandAPI::registerHyprCtlCommand(PHANDLE, SHyprCtlCommand{
+                                                                      .name = "orthodump",
+                                                                      .exact = true,
+                                                                      .fn = [](eHyprCtlOutputFormat format, std::string request) -> std::string
+                                                                      { return g_pOrthoLayout->getLayoutDump(format == FORMAT_JSON); },
+                                                                  });
+    success = success && g_pDumpCommand;
+
+    // hyprctl orthosimulate <command...>, against the focused window
+    g_pSimulateCommand = HyprlandAPI::registerHyprCtlCommand(PHANDLE, SHyprCtlCommand{
+                                                                          .name = "orthosimulate",
+                                                                          .exact = false,
+                                                                          .fn = [](eHyprCtlOutputFormat format, std::string request) -> std::string
+                                                                          {
+                                                                              CVarList vars(request, 0, ' ');
+                                                                              return g_pOrthoLayout->simulate(Desktop::focusState()->window(), vars.join(" ", 1),
+                                                                                                              format == FORMAT_JSON);
+                                                                          },
+                                                                      });
+    success = success && g_pSimulateCommand;
+
+    // hyprctl orthosoak [iterations] [seed] [max_rss_growth_kib] [max_p99_drift], on the focused window's workspace
+    g_pSoakCommand = HyprlandAPI::registerHyprCtlCommand(PHANDLE, SHyprCtlCommand{
+                                                                      .name = "orthosoak",
+                                                                      .exact = false,
+                                                                      .fn = [](eHyprCtlOutputFormat format, std::string request) -> std::string
+                                                                      {
+                                                                          CVarList vars(request, 0, ' ');
+                                                                          return g_pOrthoLayout->soak(Desktop::focusState()->window(), vars.join(" ", 1),
+                                                                                                      format == FORMAT_JSON);
+                                                                      },
+                                                                  });
+    success = success && g_pSoakCommand;
+
+    HyprlandAPI::reloadConfig();
+
     if (success)
         HyprlandAPI::addNotification(PHANDLE, "[ortho] Initialized successfully!", CHyprColor{0.2, 1.0, 0.2, 1.0}, 5000);
     else
@@ -65,6 +140,10 @@ APICALL EXPORT PLUGIN_DESCRIPTION_INFO PLUGIN_INIT(HANDLE handle)
 
 APICALL EXPORT void PLUGIN_EXIT()
 {
+    HyprlandAPI::unregisterHyprCtlCommand(PHANDLE, g_pDumpCommand);
+    HyprlandAPI::unregisterHyprCtlCommand(PHANDLE, g_pSimulateCommand);
+    HyprlandAPI::unregisterHyprCtlCommand(PHANDLE, g_pSoakCommand);
+    g_pPreConfigReloadCallback.reset();
     HyprlandAPI::removeLayout(PHANDLE, g_pOrthoLayout.get());
     g_pOrthoLayout.reset();
 }